@@ -24,6 +24,10 @@
 //    Most of this is re-implementations of functions available in ctype.h
 //    and should conform to the expected behavor
 //
+//    When ASCII_USE_CLASS_TABLE is set, the ascii_is_*() functions other than
+//    ascii_is_valid() are inlined lookups in ascii_class_table[] and codes
+//    outside the 7-bit range never belong to any class.
+//
 //
 #ifndef _ULIB_ASCII_H
 #define _ULIB_ASCII_H
@@ -31,49 +35,59 @@
 #include "src/configify.h"
 #if ULIB_ENABLE_ASCII
 
+#include "fmem.h"
 #include "types.h"
+#include "util.h"
 
 #if ! ASCII_SUBSTITUTE_WITH_CTYPE
+#if ! defined(ASCII_FUNC_INLINE)
+# if ASCII_USE_CLASS_TABLE
+#  define ASCII_FUNC_INLINE INLINE
+# else
+#  define ASCII_FUNC_INLINE
+# endif
+#endif
+
 //
 // Confirm an unsigned int is a valid 7-bit ascii code
 bool ascii_is_valid(uint_t c);
 //
 // Check if 'c' is a control code
-bool ascii_is_cntrl(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_cntrl(uint8_t c);
 //
 // Check if 'c' is a printable character, including space
-bool ascii_is_print(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_print(uint8_t c);
 //
 // Check if 'c' is a printable character, excluding space
-bool ascii_is_graph(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_graph(uint8_t c);
 //
 // Check if 'c' is a space, formfeed, newline, carriage return, tab, or
 // vertical tab
-bool ascii_is_space(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_space(uint8_t c);
 //
 // Check if 'c' is a space or tab
-bool ascii_is_blank(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_blank(uint8_t c);
 //
 // Check if 'c' is a digit ('0'-'9')
-bool ascii_is_digit(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_digit(uint8_t c);
 //
 // Check if 'c' is hexadecimal digit ('0'-'9', 'a'-'f', or 'A'-'F')
-bool ascii_is_xdigit(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_xdigit(uint8_t c);
 //
 // Check if 'c' is alphabetical ('a'-'z' or 'A'-'Z')
-bool ascii_is_alpha(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_alpha(uint8_t c);
 //
 // Check if 'c' is alphanumeric ('0'-'9', 'a'-'z', or 'A'-'Z')
-bool ascii_is_alnum(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_alnum(uint8_t c);
 //
 // Check if 'c' is a printable character other than a digit, letter, or space
-bool ascii_is_punct(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_punct(uint8_t c);
 //
 // Check if 'c' is in the range of 'a'-'z'
-bool ascii_is_lower(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_lower(uint8_t c);
 //
 // Check if 'c' is in the range of 'A'-'Z'
-bool ascii_is_upper(uint8_t c);
+ASCII_FUNC_INLINE bool ascii_is_upper(uint8_t c);
 
 //
 // Convert 'c' from  the range 'a'-'z' to 'A' - 'Z'
@@ -82,6 +96,77 @@ uint8_t ascii_to_upper(uint8_t c);
 // Convert 'c' from  the range 'A'-'Z' to 'a' - 'z'
 uint8_t ascii_to_lower(uint8_t c);
 
+#if ASCII_USE_CLASS_TABLE
+//
+// Character classes as stored in ascii_class_table[]
+#define ASCII_CLASS_CNTRL  0x01U
+#define ASCII_CLASS_SPACE  0x02U
+#define ASCII_CLASS_BLANK  0x04U
+#define ASCII_CLASS_DIGIT  0x08U
+#define ASCII_CLASS_UPPER  0x10U
+#define ASCII_CLASS_LOWER  0x20U
+// The letters 'a'-'f' and 'A'-'F'
+#define ASCII_CLASS_HEX    0x40U
+#define ASCII_CLASS_PUNCT  0x80U
+// Combinations matching the ascii_is_*() functions
+#define ASCII_CLASS_ALPHA  (ASCII_CLASS_UPPER | ASCII_CLASS_LOWER)
+#define ASCII_CLASS_ALNUM  (ASCII_CLASS_ALPHA | ASCII_CLASS_DIGIT)
+#define ASCII_CLASS_XDIGIT (ASCII_CLASS_DIGIT | ASCII_CLASS_HEX)
+#define ASCII_CLASS_GRAPH  (ASCII_CLASS_ALNUM | ASCII_CLASS_PUNCT)
+//
+// The classes each code belongs to, indexed by code
+extern FMEM_STORAGE const uint8_t ascii_class_table[256];
+//
+// The most bytes ascii_classify_block() can handle at once
+#define ASCII_BLOCK_BYTES 32U
+//
+// Classify up to ASCII_BLOCK_BYTES bytes at once. Bit i of the result is
+// set if buf[i] belongs to any of the classes in 'classes'.
+uint32_t ascii_classify_block(const char *buf, uint_fast8_t len, uint8_t classes);
+//
+// Return the number of bytes at the start of buf which belong to any of the
+// classes in 'classes', looking at no more than len bytes.
+// This can be used to skip whitespace or identifiers a block at a time.
+size_t ascii_span(const char *buf, size_t len, uint8_t classes);
+
+ASCII_FUNC_INLINE bool ascii_is_cntrl(uint8_t c) {
+	return ((ascii_class_table[c] & ASCII_CLASS_CNTRL) != 0U);
+}
+ASCII_FUNC_INLINE bool ascii_is_print(uint8_t c) {
+	return (((ascii_class_table[c] & ASCII_CLASS_GRAPH) != 0U) || (c == ' '));
+}
+ASCII_FUNC_INLINE bool ascii_is_graph(uint8_t c) {
+	return ((ascii_class_table[c] & ASCII_CLASS_GRAPH) != 0U);
+}
+ASCII_FUNC_INLINE bool ascii_is_space(uint8_t c) {
+	return ((ascii_class_table[c] & ASCII_CLASS_SPACE) != 0U);
+}
+ASCII_FUNC_INLINE bool ascii_is_blank(uint8_t c) {
+	return ((ascii_class_table[c] & ASCII_CLASS_BLANK) != 0U);
+}
+ASCII_FUNC_INLINE bool ascii_is_digit(uint8_t c) {
+	return ((ascii_class_table[c] & ASCII_CLASS_DIGIT) != 0U);
+}
+ASCII_FUNC_INLINE bool ascii_is_xdigit(uint8_t c) {
+	return ((ascii_class_table[c] & ASCII_CLASS_XDIGIT) != 0U);
+}
+ASCII_FUNC_INLINE bool ascii_is_alpha(uint8_t c) {
+	return ((ascii_class_table[c] & ASCII_CLASS_ALPHA) != 0U);
+}
+ASCII_FUNC_INLINE bool ascii_is_alnum(uint8_t c) {
+	return ((ascii_class_table[c] & ASCII_CLASS_ALNUM) != 0U);
+}
+ASCII_FUNC_INLINE bool ascii_is_punct(uint8_t c) {
+	return ((ascii_class_table[c] & ASCII_CLASS_PUNCT) != 0U);
+}
+ASCII_FUNC_INLINE bool ascii_is_lower(uint8_t c) {
+	return ((ascii_class_table[c] & ASCII_CLASS_LOWER) != 0U);
+}
+ASCII_FUNC_INLINE bool ascii_is_upper(uint8_t c) {
+	return ((ascii_class_table[c] & ASCII_CLASS_UPPER) != 0U);
+}
+#endif // ASCII_USE_CLASS_TABLE
+
 #if ASCII_SUBSTITUTE_FOR_CTYPE
 #define isascii(_c_) ascii_is_valid(_c_)
 #define iscntrl(_c_) ascii_is_cntrl(_c_)
@@ -41,6 +41,12 @@ bool cstring_eqn(const char *s1, const char *s2, uint_t n);
 // Check if two cstrings are the same up to the length of the first string.
 bool cstring_eqz(const char *s1, const char *s2);
 //
+// Find the first occurrence of needle in hay. Neither needs to be
+// NUL-terminated and either may contain NULs.
+// Returns a pointer into hay, or NULL if needle isn't found. An empty needle
+// is found at the start of hay.
+const char* cstring_find(const char *hay, size_t hay_len, const char *needle, size_t needle_len);
+//
 // Return a pointer to the first non-whitespace character in s.
 const char* cstring_eat_whitespace(const char *s);
 //
@@ -83,11 +89,38 @@ char *cstring_tr(char *s, char old, char new);
 // excluding the trailing NUL byte
 // Returns 0 on any error other than the buffer being too small
 uint_t cstring_from_uint(char *dest, uint_t size, uint_t src, uint_t base);
+//
+// Write the decimal digits of an unsigned integer so that the last digit is
+// at end[-1] and return a pointer to the first digit. No NUL byte is written.
+// There must be room for CSTRING_UINT32_DIGITS or CSTRING_UINT64_DIGITS bytes
+// before 'end'.
+// These are the shared core used for integer conversion by this module, the
+// printf module, and the strings module. Two digits are produced per step
+// from a lookup table, using multiplication by a reciprocal in place of
+// division; 64-bit values which fit in 32 bits take the 32-bit path.
+#define CSTRING_UINT32_DIGITS 10U
+#define CSTRING_UINT64_DIGITS 20U
+char* cstring_from_uint32_end(char *end, uint32_t n);
+char* cstring_from_uint64_end(char *end, uint64_t n);
+
+//
+// Parse an integer in base 10 or 16 from the start of s, which is at most
+// len bytes long and needn't be NUL-terminated. If len is 0 strlen() is used.
+// cstring_to_int64() accepts a leading '+' or '-'; neither accepts a '0x'
+// prefix or leading whitespace.
+// If ret_end isn't NULL, it's set to the first character that wasn't part of
+// the number, or to s if there were no digits.
+// On overflow the result is clamped to the largest or smallest value of the
+// type and all the digits are still consumed.
+// Returns false if there were no digits or the value overflowed.
+bool cstring_to_uint64(const char *s, size_t len, uint_fast8_t base, uint64_t *ret_value, const char **ret_end);
+bool cstring_to_int64(const char *s, size_t len, uint_fast8_t base, int64_t *ret_value, const char **ret_end);
 
 //
 // In-line conversion of a segment of a c-string (_s) to an integer (_i).
 // This will increment _s and expects to deal only with characters 0-9, signs
 // will have to be handled by the caller beforehand.
+// There's no overflow checking; use cstring_to_uint64() when that matters.
 #define UINT_FROM_CSTRING_BASE10(_i, _s) \
 	do { \
 		(_i) = 0; \
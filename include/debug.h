@@ -27,7 +27,6 @@
 
 #include "src/configify.h"
 #include "fmem.h"
-#include "msg.h"
 #include "types.h"
 
 #if !ULIB_ENABLE_FMEM
@@ -78,6 +77,10 @@ void ulib_panic_abort(const char *file_path, uint32_t lineno, const char *func_n
 # define ulib_panic(_msg_) ((void )0)
 #endif
 
+// msg.h uses ulib_assert() in inline functions, so it has to be included
+// after that's defined.
+#include "msg.h"
+
 #define PRINT_HERE() msg_debug("-HERE- %s() %s:%d", __func__, F1(__FILE__), __LINE__)
 #define PRINT_VALUE(_val_) (msg_debug("%s: 0x%02X", #_val_, (uint_t )_val_))
 
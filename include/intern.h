@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/***********************************************************************
+*                                                                      *
+*                                                                      *
+* Copyright 2024 svijsv                                                *
+* This program is free software: you can redistribute it and/or modify *
+* it under the terms of the GNU General Public License as published by *
+* the Free Software Foundation, version 3.                             *
+*                                                                      *
+* This program is distributed in the hope that it will be useful, but  *
+* WITHOUT ANY WARRANTY; without even the implied warranty of           *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+* General Public License for more details.                             *
+*                                                                      *
+* You should have received a copy of the GNU General Public License    *
+* along with this program. If not, see <http:// www.gnu.org/licenses/>.*
+*                                                                      *
+*                                                                      *
+***********************************************************************/
+// intern.h
+// Keep a single canonical copy of each distinct string
+//
+// NOTES:
+//    Interning the same characters twice in the same table returns the same
+//    handle, so two handles from one table hold equal strings if and only if
+//    they're the same pointer.
+//
+//    Interned strings can't be modified or freed individually. They remain
+//    valid until the table they came from is cleared.
+//
+//    When INTERN_USE_LOCKING is set, any function other than intern_init()
+//    may be called on the same table from several threads at once. The lock
+//    is a spinlock, so on single-core systems a table shouldn't be used from
+//    both interrupt handlers and the main loop.
+//
+//    This module requires malloc().
+//
+//
+#ifndef _ULIB_INTERN_H
+#define _ULIB_INTERN_H
+
+#include "src/configify.h"
+#if ULIB_ENABLE_INTERN
+
+#include "strings.h"
+#include "types.h"
+#include "util.h"
+
+
+// An interned string.
+typedef struct {
+	// The value returned by strview_hash() for the string.
+	uint32_t hash;
+	strlen_t length;
+	// The NUL-terminated string.
+	char cstring[];
+} interned_t;
+
+typedef struct {
+	// The hash table; slot_count is always 0 or a power of 2.
+	const interned_t **slots;
+	uint32_t slot_count;
+	// Number of distinct strings in the table.
+	uint32_t count;
+	// Storage for the interned strings.
+	struct intern_block_t *blocks;
+	// Running totals reported by intern_get_usage().
+	size_t string_bytes;
+	size_t entry_bytes;
+	size_t block_bytes;
+	uint32_t duplicates;
+	size_t saved_bytes;
+#if INTERN_USE_LOCKING
+	char locked;
+#endif
+} intern_table_t;
+
+// Memory usage of an intern table.
+typedef struct {
+	// Number of distinct strings in the table.
+	uint32_t entries;
+	// Number of slots in the hash table.
+	uint32_t slots;
+	// Bytes of string data including the trailing NULs.
+	size_t string_bytes;
+	// Bytes used by interned strings including their headers and padding.
+	size_t entry_bytes;
+	// Bytes allocated to hold interned strings.
+	size_t block_bytes;
+	// Bytes allocated for the hash table.
+	size_t table_bytes;
+	// block_bytes + table_bytes.
+	size_t total_bytes;
+	// Number of times an already-interned string was interned again. Lookups
+	// with intern_find() aren't counted.
+	uint32_t duplicates;
+	// Bytes of string data those duplicates would otherwise have used.
+	size_t saved_bytes;
+} intern_usage_t;
+
+
+// Initialize an intern table which is presumed to be filled with junk.
+intern_table_t* intern_init(intern_table_t *t);
+//
+// Release all memory used by an intern table. Every handle taken from it
+// becomes invalid, but the table itself can be used again.
+intern_table_t* intern_clear(intern_table_t *t);
+//
+// Return the canonical handle for a string, adding it if needed.
+// For intern_cstring(), if len is 0 strlen() is used.
+// Returns NULL if the string wasn't already interned and allocation failed.
+const interned_t* intern_strview(intern_table_t *t, strview_t v);
+const interned_t* intern_cstring(intern_table_t *t, const char *c, strlen_t len);
+const interned_t* intern_string(intern_table_t *t, const string_t *s);
+//
+// Return the canonical handle for a string if it's been interned, or NULL
+// if it hasn't.
+const interned_t* intern_find(intern_table_t *t, strview_t v);
+//
+// Intern count strings at once, taking the lock and sizing the hash table
+// only once.
+// If ret_handles isn't NULL, the handle for views[i] is stored in
+// ret_handles[i] (or NULL on failure).
+// Returns the number of strings successfully interned.
+uint32_t intern_bulk(intern_table_t *t, const strview_t *views, uint32_t count, const interned_t **ret_handles);
+//
+// Report on the memory used by an intern table.
+intern_usage_t* intern_get_usage(intern_table_t *t, intern_usage_t *ret_usage);
+//
+// Return a view of an interned string.
+INLINE strview_t intern_view(const interned_t *h) {
+	strview_t v;
+
+	v.ptr = h->cstring;
+	v.length = h->length;
+
+	return v;
+}
+
+
+#endif // ULIB_ENABLE_INTERN
+#endif // _ULIB_INTERN_H
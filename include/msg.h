@@ -37,7 +37,9 @@
 #include "src/configify.h"
 #if ULIB_ENABLE_MSG
 
+#include "debug.h"
 #include "types.h"
+#include "util.h"
 
 #include <time.h>
 
@@ -50,6 +52,8 @@
 #define MSG_VERB_INFO     1
 #define MSG_VERB_EXTRA    2
 #define MSG_VERB_TMI      3
+// Used with msg_set_module_verbosity() to follow the global verbosity level
+#define MSG_VERB_INHERIT  (-128)
 
 /*
  * Flags passed to msg_config() to change msg.c behavior
@@ -67,6 +71,8 @@
 #define MSG_FLAG_LOG_DIRECT    0x10U
 // Always print messages in msg_ask() even when not interactive
 #define MSG_FLAG_ALWAYS_PRINT_QUESTIONS 0x20U
+// Rate-limit error and warning messages; see rate_limit_burst in msg_config_t
+#define MSG_FLAG_RATE_LIMIT    0x40U
 
 /*
  * Structure passed to msg_config() to configure the module.
@@ -102,6 +108,7 @@ typedef struct {
 	// Must return the pointer to the start of the formatted time, which doesn't
 	// necessarily need to be in 'buf'.
 	// Set to NULL to keep the current value. Disabled by default.
+	// When MSG_USE_UNIX_IO is set, msg_print_log_time_cached() may be used here.
 	const char* (*print_log_time)(char *buf, size_t size);
 
 #if MSG_USE_UNIX_IO
@@ -118,6 +125,21 @@ typedef struct {
 	// current value and any other negative number to disable log output.
 	// msg_open_log() and msg_close_log() will close this fd if called.
 	int log_fd;
+	// Rotate the log file opened by msg_open_log() once it grows to at least
+	// this many bytes. Set to 0 to disable; defaults to 0.
+	off_t log_max_bytes;
+	// Rotate the log file opened by msg_open_log() once it's been open for at
+	// least this many seconds. Set to 0 to disable; defaults to 0.
+	time_t log_max_age_sec;
+	// Number of rotated logs to keep, named '<path>.1' (newest) through
+	// '<path>.N' (oldest). If 0, the log is discarded when rotated. Defaults to 0.
+	uint_fast8_t log_keep_count;
+	// If > 0, reserve space for the log file opened by msg_open_log() in
+	// blocks of this many bytes to reduce fragmentation and file system
+	// metadata updates. Only supported on some systems. The file's size isn't
+	// changed, and reserved space that's never written is released only when
+	// the file is truncated or removed. Defaults to 0.
+	off_t log_prealloc_bytes;
 #else
 	// Function used for stdin. Set to NULL to keep current value. Disabled by default.
 	ssize_t (*stdin_read)(uint8_t *buf, size_t count);
@@ -129,6 +151,19 @@ typedef struct {
 	ssize_t (*log_write)(const uint8_t *buf, size_t count);
 #endif
 
+#if MSG_RATE_LIMIT_SLOTS > 0
+	// When MSG_FLAG_RATE_LIMIT is set, each call site (identified by its format
+	// string) of msg_error(), msg_errno(), msg_liberrno(), msg_warn(), and
+	// msg_warnno() may print at most rate_limit_burst messages in any
+	// rate_limit_period_ms milliseconds. Messages beyond that are dropped and
+	// counted, and the count is printed once the call site is allowed to print
+	// again. If more call sites are busy than there are MSG_RATE_LIMIT_SLOTS,
+	// some of them may end up sharing a limit. Set either to 0 to disable;
+	// both default to 0.
+	uint_fast16_t rate_limit_burst;
+	uint_fast32_t rate_limit_period_ms;
+#endif
+
 	// Verbosity level for printing messages; default is 0.
 	int_fast8_t verbosity;
 	// Behavior-modifying flags; defaults to 0.
@@ -191,8 +226,29 @@ int msg_get_config(msg_config_t *cfg);
  * If opening the new file fails, the current log output is left unchanged.
  *
  * If path is NULL or empty or opening the new file fails, return an error.
+ *
+ * If log rotation is enabled in the configuration, the log is checked after
+ * each message written by msg_log(). When rotation is due the old files are
+ * renamed and a new log file is opened and swapped in before the next message
+ * is written. If the new file can't be opened, logging continues in the old
+ * one.
  */
 int msg_open_log(const char* path);
+/*
+ * msg_print_log_time_cached()
+ * Print the current time to buf in the format 'YYYY.MM.DD_HH:mm:ss[.fff]'.
+ *
+ * This is intended to be used as the print_log_time() function in msg_config_t.
+ * The rendered time is cached between calls so that only the fields which
+ * have changed since the last message are re-formatted, and when used by
+ * msg_log() the cache is written out directly instead of going through buf.
+ *
+ * The clock, time zone, and number of sub-second digits are set with the
+ * MSG_LOG_TIME_* configuration options.
+ *
+ * Returns buf, which is set to an empty string if the time couldn't be read.
+ */
+const char* msg_print_log_time_cached(char *buf, size_t size);
 /*
  * msg_close_log()
  * Close the log file.
@@ -200,6 +256,63 @@ int msg_open_log(const char* path);
  * If no log file is currently open, return successfully.
  */
 int msg_close_log(void);
+
+# if MSG_USE_RING_LOG
+/*
+ * msg_open_ring_log()
+ * Open a memory-mapped circular log file of 'size' bytes.
+ *
+ * Every message passed to msg_print(), msg_log(), msg_debug(), and the error
+ * and warning functions is copied to the ring log regardless of verbosity or
+ * output settings. While it's open, the MSG_PRINT() macros evaluate their
+ * arguments for every message so they can be recorded, but still only print
+ * those allowed by the verbosity level. Messages are stored in the mapped file directly so no system calls are
+ * made when writing and the contents survive if the process crashes.
+ *
+ * Messages are split into MSG_RING_LOG_RECORD_BYTES records, each tagged with a
+ * sequence number; once the file is full, the oldest records are overwritten.
+ *
+ * If the file already holds a ring log with the same record size, the
+ * sequence numbers continue from where it left off. Otherwise it's resized
+ * and cleared.
+ *
+ * If a ring log is already open it's closed first.
+ *
+ * Returns 0 on success or an error code on failure.
+ */
+int msg_open_ring_log(const char *path, size_t size);
+/*
+ * msg_close_ring_log()
+ * Unmap the ring log file.
+ *
+ * If no ring log is open, return successfully.
+ */
+int msg_close_ring_log(void);
+/*
+ * msg_dump_ring_log()
+ * Write the messages stored in a ring log file to fd, oldest first.
+ *
+ * The file doesn't need to have been opened by this process, and this may be
+ * used on the file belonging to a running or crashed one. Partially-written
+ * records are skipped.
+ *
+ * Returns the number of messages written or an error code on failure.
+ */
+int msg_dump_ring_log(const char *path, int fd);
+# endif
+#endif
+
+#if MSG_RATE_LIMIT_SLOTS > 0
+/*
+ * msg_flush_suppressed()
+ * Print the number of messages suppressed by rate-limiting which haven't been
+ * reported yet.
+ *
+ * Suppressed messages are normally reported the next time the call site that
+ * produced them is allowed to print, so this should be called before exiting
+ * if MSG_FLAG_RATE_LIMIT is used.
+ */
+void msg_flush_suppressed(void);
 #endif
 
 /*
@@ -279,8 +392,85 @@ void msg_debug(const char *restrict fmt, ...)
  */
 void msg_print(int8_t priority, const char *restrict fmt, ...)
 	__attribute__ ((format(printf, 2, 3)));
-// This may be more efficient, but not majorly so (and I'd have to export msg_verbosity):
-//#define msg_print(priority, ...) (if (priority <= msg_verbosity) _msg_print( ## __VA_ARGS__);)
+
+/*
+ * Verbosity-filtering front ends
+ *
+ * MSG_PRINT() and MSG_PRINT_MODULE() check the verbosity level before the
+ * message arguments are evaluated, so nothing is done at all for messages
+ * which would be discarded. Messages with a constant priority greater than
+ * MSG_VERBOSITY_MAX are removed at compile time.
+ *
+ * MSG_PRINT_MODULE() uses the verbosity set for 'module' with
+ * msg_set_module_verbosity(), or the global level if that's MSG_VERB_INHERIT
+ * (the default). Module IDs range from 0 to MSG_MODULE_COUNT-1.
+ *
+ * MSG_DEBUG() is removed entirely unless DEBUG is non-zero.
+ *
+ * Don't access _msg_verbosity, _msg_module_verbosity, or _msg_ring_log_open
+ * directly.
+ */
+extern int_fast8_t _msg_verbosity;
+#if MSG_USE_UNIX_IO && MSG_USE_RING_LOG
+extern bool _msg_ring_log_open;
+# define MSG_RING_LOG_IS_OPEN() (_msg_ring_log_open)
+#else
+# define MSG_RING_LOG_IS_OPEN() (false)
+#endif
+void _msg_print(bool print, const char *restrict fmt, ...)
+	__attribute__ ((format(printf, 2, 3)));
+#define MSG_WANTS_PRIORITY(_priority_) \
+	(((_priority_) <= MSG_VERBOSITY_MAX) && (((_priority_) <= _msg_verbosity) || MSG_RING_LOG_IS_OPEN()))
+#define MSG_PRINT(_priority_, ...) \
+	do { \
+		if (MSG_WANTS_PRIORITY(_priority_)) { \
+			msg_print((_priority_), __VA_ARGS__); \
+		} \
+	} while (0)
+
+#if MSG_MODULE_COUNT > 0
+// Module levels are stored offset by -MSG_VERB_INHERIT so that the default
+// zero-initialized value means MSG_VERB_INHERIT.
+extern uint8_t _msg_module_verbosity[MSG_MODULE_COUNT];
+INLINE bool msg_module_wants_priority(uint_fast8_t module, int_fast8_t priority) {
+	int_fast8_t v;
+
+	ulib_assert(module < MSG_MODULE_COUNT);
+# if DO_MSG_SAFETY_CHECKS
+	if (module >= MSG_MODULE_COUNT) {
+		return false;
+	}
+# endif
+
+	v = (int_fast8_t )((int_fast16_t )_msg_module_verbosity[module] + MSG_VERB_INHERIT);
+	return (priority <= ((v == MSG_VERB_INHERIT) ? _msg_verbosity : v));
+}
+# define MSG_PRINT_MODULE(_module_, _priority_, ...) \
+	do { \
+		if ((_priority_) <= MSG_VERBOSITY_MAX) { \
+			bool _msg_print_it_ = msg_module_wants_priority((_module_), (_priority_)); \
+			if (_msg_print_it_ || MSG_RING_LOG_IS_OPEN()) { \
+				_msg_print(_msg_print_it_, __VA_ARGS__); \
+			} \
+		} \
+	} while (0)
+/*
+ * msg_set_module_verbosity()
+ * Change the verbosity level used by MSG_PRINT_MODULE() for one module.
+ *
+ * Set to MSG_VERB_INHERIT to use the global verbosity level.
+ *
+ * Returns the old level, or MSG_VERB_INHERIT if the module ID is invalid.
+ */
+int_fast8_t msg_set_module_verbosity(uint_fast8_t module, int_fast8_t verbosity);
+#endif
+
+#if defined(DEBUG) && DEBUG
+# define MSG_DEBUG(...) msg_debug(__VA_ARGS__)
+#else
+# define MSG_DEBUG(...) ((void )0)
+#endif
+
 /*
  * msg_puts()
  * Print a string to stdout
@@ -301,6 +491,27 @@ int msg_puts(const char *s);
  * success or -errno on error.
  */
 int msg_gets(char *s, int size);
+/*
+ * msg_getline()
+ * Retrieve a line from stdin without copying it
+ *
+ * On success, *line is set to point to the line inside the input buffer and
+ * its length is returned. The line isn't NUL-terminated, the trailing newline
+ * is not included, and carriage returns and backspaces are handled the same
+ * way as in msg_gets(). A NUL byte ends the line like a newline does.
+ *
+ * The pointer is only valid until the next call to msg_getline(), msg_gets(),
+ * or msg_ask(). If a line is longer than MSG_STDIN_BUFFER_BYTES it's returned
+ * in pieces.
+ *
+ * On EOF, returns 0 with *line set to NULL; an empty line returns 0 with
+ * *line set to non-NULL. Returns -errno on error.
+ *
+ * msg_gets(), msg_getline(), and msg_ask() share the same input buffer and
+ * may be mixed freely, but stdin shouldn't be read by anything else while
+ * they're in use since the buffer may hold input that hasn't been used yet.
+ */
+int msg_getline(const char **line);
 
 #endif // _ULIB_MSG_H
 #endif // ULIB_ENABLE_MSG
@@ -50,6 +50,7 @@
 //    '  : For decimal integers, print a separator at each thousands place.
 //
 // Of the standard length modifiers, this implementation supports:
+//    L  : long double (only with PRINTF_ALLOW_FLOATS)
 //    hh : char
 //    h  : short
 //    l  : long
@@ -74,20 +75,126 @@
 //    c  : Unsigned char (passed as an int).
 //    s  : String.
 //    %  : A literal '%'.
+// The following are only supported if PRINTF_ALLOW_FLOATS is set:
+//    f,F: Double in decimal notation.
+//    e,E: Double in exponential notation.
+//    g,G: Double in decimal or exponential notation depending on the exponent.
 //
 // These functions differ from the standard printf() in the following ways:
 //    The 'l' flags are not supported for %c or %s.
 //
 //    The '%m$' notation for accessing arguments by index isn't supported.
 //
-//    The number of characters written is not returned.
+//    The number of characters written is not returned, except by
+//    ulib_snprintf() and ulib_vsnprintf().
 //
 //    At least one digit is always printed for integers instead of printing
 //    nothing for '0' when the precision is 0.
 //
+//    If PRINTF_FLOAT_SHORTEST_G is set and no precision is given for %g or
+//    %G, the shortest representation that reads back as the same double is
+//    printed instead of rounding to 6 significant digits; exponential
+//    notation is used if the exponent is less than -4 or at least as large as
+//    the larger of 6 and the number of digits. Values passed as floats are
+//    printed as the doubles they're promoted to.
+//
+//    Floating-point values are correctly rounded but digits past the first
+//    PRINTF_FLOAT_MAX_DIGITS significant digits are printed as 0s. Long
+//    doubles are rounded to doubles first. The ' flag is ignored for them.
+//
 void ulib_printf(void (*pputc)(uint_fast8_t c), const char *restrict fmt, ...)
 	__attribute__ ((format(printf, 2, 3)));
 void ulib_vprintf(void (*pputc)(uint_fast8_t c), const char *restrict fmt, va_list arp);
 
+// An output sink for ulib_printf_sink() and ulib_vprintf_sink().
+// Instead of being passed one character at a time, write() is passed runs
+// of characters: spans of literal text from the format string, padding,
+// converted integers, and whole strings. 'ctx' is passed to write() unchanged.
+// The buffer passed to write() is only valid for the duration of the call.
+typedef struct {
+	void (*write)(void *ctx, const char *buf, size_t len);
+	void *ctx;
+} printf_sink_t;
+//
+// Print printf-formatted strings through a sink. These accept the same format
+// strings as ulib_printf() and ulib_vprintf(), which are implemented on top
+// of them. ulib_vprintf_sink() is defined weakly.
+void ulib_printf_sink(const printf_sink_t *sink, const char *restrict fmt, ...)
+	__attribute__ ((format(printf, 2, 3)));
+void ulib_vprintf_sink(const printf_sink_t *sink, const char *restrict fmt, va_list arp);
+
+// Print printf-formatted strings to buf, writing at most 'size' bytes
+// including the trailing NUL byte. ulib_snprintf() is comparable to
+// snprintf() and ulib_vsnprintf() to vsnprintf().
+//
+// Unlike the other printing functions, these return the number of characters
+// the whole formatted string requires, excluding the trailing NUL byte; if
+// that's >= size, the output was truncated. Output is always NUL-terminated
+// when size > 0.
+//
+// If buf is NULL and size is 0, nothing is written and only the length is
+// calculated, so that an exactly-sized buffer can be allocated beforehand.
+size_t ulib_snprintf(char *restrict buf, size_t size, const char *restrict fmt, ...)
+	__attribute__ ((format(printf, 3, 4)));
+size_t ulib_vsnprintf(char *restrict buf, size_t size, const char *restrict fmt, va_list arp);
+
+// Pre-compiled format strings.
+//
+// ulib_printf_compile() splits a format string into a list of ops, each made
+// up of a span of literal text followed by at most one conversion, so that
+// ulib_printf_compiled() and ulib_vprintf_compiled() can print it repeatedly
+// without parsing the format string each time. The literal spans point into
+// the format string, which must outlive the ops.
+//
+// ulib_printf_compile() returns the number of ops needed for the whole format
+// string. If that's more than max_ops, only the first max_ops are stored.
+// Passing NULL and 0 just counts them.
+//
+// Op lists can also be built at compile time with PRINTF_OP() and
+// PRINTF_OP_LITERAL(); for example "x=%-5d\n" is the same as:
+//    static const printf_op_t x_ops[] = {
+//       PRINTF_OP("x=", 'd', PRINTF_OP_FLAG_LEFT_ADJUST, 5, 0, sizeof(int)),
+//       PRINTF_OP_LITERAL("\n"),
+//    };
+//
+// Arguments to compiled formats can't be checked by the compiler, so take
+// care that they match.
+typedef struct {
+	const char *literal;
+	uint16_t literal_len;
+	// PRINTF_OP_FLAG_* flags.
+	uint16_t flags;
+	// The conversion character ('d', 's', etc.) or 0 for none.
+	uint8_t conversion;
+	uint8_t width;
+	uint8_t precision;
+	// The size of integer arguments in bytes.
+	uint8_t int_size;
+} printf_op_t;
+// Flags corresponding to the format string flags '0', '-', ' ', '+', ''', and
+// '#'; to '*' given for the width or precision; and to a precision being given
+// at all, which matters for floating-point conversions where '.0' isn't the
+// same as no precision.
+#define PRINTF_OP_FLAG_PAD_0         0x01U
+#define PRINTF_OP_FLAG_LEFT_ADJUST   0x02U
+#define PRINTF_OP_FLAG_POS_BLANK     0x04U
+#define PRINTF_OP_FLAG_POS_PLUS      0x08U
+#define PRINTF_OP_FLAG_GROUP_1000s   0x10U
+#define PRINTF_OP_FLAG_ALT_FORM      0x20U
+#define PRINTF_OP_FLAG_WIDTH_ARG     0x40U
+#define PRINTF_OP_FLAG_PRECISION_ARG 0x80U
+#define PRINTF_OP_FLAG_PRECISION     0x100U
+// _lit_ must be a string literal.
+#define PRINTF_OP_LITERAL(_lit_) \
+	{ .literal = (_lit_), .literal_len = (uint16_t )(sizeof(_lit_) - 1U) }
+#define PRINTF_OP(_lit_, _conversion_, _flags_, _width_, _precision_, _int_size_) \
+	{ .literal = (_lit_), .literal_len = (uint16_t )(sizeof(_lit_) - 1U), \
+	  .flags = (_flags_), .conversion = (_conversion_), .width = (_width_), \
+	  .precision = (_precision_), .int_size = (_int_size_) }
+
+uint_t ulib_printf_compile(printf_op_t *ops, uint_t max_ops, const char *restrict fmt);
+void ulib_printf_compiled(const printf_sink_t *sink, const printf_op_t *ops, uint_t op_count, ...);
+void ulib_vprintf_compiled(const printf_sink_t *sink, const printf_op_t *ops, uint_t op_count, va_list arp);
+
 #endif // ULIB_ENABLE_PRINTF
 #endif // _ULIB_PRINTF_H
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/***********************************************************************
+*                                                                      *
+*                                                                      *
+* Copyright 2024 svijsv                                                *
+* This program is free software: you can redistribute it and/or modify *
+* it under the terms of the GNU General Public License as published by *
+* the Free Software Foundation, version 3.                             *
+*                                                                      *
+* This program is distributed in the hope that it will be useful, but  *
+* WITHOUT ANY WARRANTY; without even the implied warranty of           *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+* General Public License for more details.                             *
+*                                                                      *
+* You should have received a copy of the GNU General Public License    *
+* along with this program. If not, see <http:// www.gnu.org/licenses/>.*
+*                                                                      *
+*                                                                      *
+***********************************************************************/
+// rope.h
+// Build up large strings in pieces without ever re-allocating them
+//
+// NOTES:
+//    A rope is a sequence of spans. Copied text is packed into blocks of
+//    ROPE_BLOCK_BYTES which are never moved once allocated, and borrowed
+//    text is referenced where it lies. Neither kind of append copies
+//    anything that was appended earlier.
+//
+//    Borrowed memory must stay valid and unchanged until the rope is cleared.
+//
+//    Unless otherwise noted, functions returning rope_t* return the same
+//    object passed to them.
+//
+//    When allocation fails, whatever couldn't be added is dropped and the
+//    rope's 'truncated' field is set. It stays set until the rope is cleared.
+//
+//    This module requires malloc().
+//
+//
+#ifndef _ULIB_ROPE_H
+#define _ULIB_ROPE_H
+
+#include "src/configify.h"
+#if ULIB_ENABLE_ROPE
+
+#include "strings.h"
+#include "types.h"
+#include "util.h"
+
+#include <stdarg.h>
+#if ROPE_USE_IOVEC
+# include <sys/uio.h>
+#endif
+
+
+// A contiguous run of characters in a rope.
+typedef struct {
+	const char *ptr;
+	size_t length;
+} rope_span_t;
+
+typedef struct {
+	// The pieces of the rope in order.
+	rope_span_t *spans;
+	size_t span_count;
+	size_t spans_allocated;
+	// Blocks holding copied text, newest first.
+	struct rope_block_t *blocks;
+	// Total length of the rope in bytes.
+	size_t length;
+	// Set when something couldn't be added.
+	bool truncated;
+} rope_t;
+
+
+// Initialize a rope which is presumed to be filled with junk.
+rope_t* rope_init(rope_t *r);
+//
+// Release all memory used by a rope and empty it. The rope_t itself remains
+// valid.
+rope_t* rope_clear(rope_t *r);
+//
+// Copy text onto the end of a rope.
+// For rope_append_cstring(), if len is 0 strlen() is used.
+rope_t* rope_append(rope_t *r, const void *buf, size_t len);
+rope_t* rope_append_cstring(rope_t *r, const char *c, size_t len);
+rope_t* rope_append_string(rope_t *r, const string_t *s);
+rope_t* rope_append_strview(rope_t *r, strview_t v);
+//
+// Add a reference to text on the end of a rope without copying it.
+rope_t* rope_append_borrowed(rope_t *r, const void *buf, size_t len);
+//
+// Append to a rope with vsprintf()- or sprintf()-like format strings.
+#if ULIB_ENABLE_PRINTF
+rope_t* rope_appendf_va(rope_t *restrict r, const char *restrict format, va_list arp);
+rope_t* rope_appendf(rope_t *restrict r, const char *restrict format, ...)
+	__attribute__ ((format(printf, 2, 3)));
+#endif
+//
+// Copy the contents of a rope into a string, replacing whatever was there.
+// The string is truncated if the rope is too long to fit.
+string_t* rope_flatten(const rope_t *r, string_t *s);
+//
+// Copy up to size bytes of a rope into buf, starting offset bytes in.
+// No NUL is added.
+// Returns the number of bytes copied.
+size_t rope_copy(const rope_t *r, size_t offset, void *buf, size_t size);
+
+#if ROPE_USE_IOVEC
+//
+// Describe up to max_iov spans of a rope, starting with span first_span,
+// in ret_iov. The iov_base fields point to the rope's data, which must not
+// be written through them.
+// Returns the number of entries filled in.
+size_t rope_get_iovec(const rope_t *r, size_t first_span, struct iovec *ret_iov, size_t max_iov);
+//
+// Write a whole rope to a file descriptor using writev(), retrying on
+// partial writes and EINTR.
+// Returns the number of bytes written, which is less than the rope's length
+// only if an error occurred, in which case errno is set.
+size_t rope_write_fd(const rope_t *r, int fd);
+#endif // ROPE_USE_IOVEC
+
+
+#endif // ULIB_ENABLE_ROPE
+#endif // _ULIB_ROPE_H
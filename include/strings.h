@@ -33,8 +33,20 @@
 //   coding. It would probably work as signed most of the time, but there are
 //   no guarantees.
 //
-//   *_printf()/_appendf() functions aren't thread safe when STRINGS_USE_INTERNAL_PRINTF
-//   is set.
+//   When STRINGS_CACHE_HASH is set, string_invalidate_hash() must be called
+//   after changing a string's contents other than through these functions.
+//
+//   When STRINGS_USE_SHARING is set, a string's allocated buffer may be shared
+//   with other strings. It's copied the first time any of them is changed,
+//   so cstring must only be modified through the functions here. Sharing
+//   is safe between threads when STRINGS_SHARE_ATOMIC is set, but a single
+//   string_t still mustn't be used by several threads at once.
+//
+//   When STRINGS_USE_MALLOC is set and STRING_SMALL_BYTES isn't 0, short
+//   strings are kept in a buffer inside the string_t itself and cstring
+//   points there. An initialized string_t must not be copied or moved
+//   by assignment or memcpy() because the copy's cstring would still
+//   point into the original.
 //
 //
 #ifndef _ULIB_STRINGS_H
@@ -49,6 +61,12 @@
 
 #include <stdarg.h>
 
+
+// Method of string growth. See config_template.h for descriptions.
+#define STRING_GROW_ADD  1
+#define STRING_GROW_MUL  2
+#define STRING_GROW_FRAC 3
+
 #if STRING_MAX_BYTES < 0xFFU
 typedef uint8_t strlen_t;
 #elif STRING_MAX_BYTES < 0xFFFFU
@@ -61,19 +79,62 @@ typedef uint64_t strlen_t;
 # error "STRING_MAX_BYTES is too big"
 #endif
 
+#if STRINGS_USE_ARENAS
+// A bump allocator over a caller-supplied buffer.
+// Only the most recent allocation can be grown, shrunk, or released in
+// place; space given up by any other is only recovered when the whole
+// arena is reset.
+typedef struct {
+	char *base;
+	size_t size;
+	size_t used;
+	char *last;
+} string_arena_t;
+#endif
+
 typedef struct {
 #if ULIB_USE_STRUCT_ID
 	struct_id_t id;
 #endif
 	strlen_t length;
+#if STRINGS_CACHE_HASH
+	// The value of strview_hash() for the contents, or 0 if it hasn't been
+	// calculated since they last changed.
+	uint32_t hash;
+#endif
 #if STRINGS_USE_MALLOC
 	strlen_t allocated;
+# if STRINGS_USE_SHARING
+	// This can't be restrict-qualified because it may point to a buffer
+	// shared with other strings.
+	char *cstring;
+# else
 	char *restrict cstring;
+# endif
+# if STRINGS_USE_ARENAS
+	string_arena_t *arena;
+# endif
+# if STRING_SMALL_BYTES > 0
+	char small[STRING_SMALL_BYTES];
+# endif
 #else
 	char cstring[STRING_MAX_BYTES+1];
 #endif
 } string_t;
 
+// A non-owning view of part of a string or cstring.
+// The characters aren't NUL-terminated in general and stay owned by
+// whatever they were taken from, which must outlive the view.
+typedef struct {
+	const char *ptr;
+	strlen_t length;
+} strview_t;
+
+// Returned by search functions when nothing is found. This is never a valid
+// position because STRING_MAX_BYTES is always less than the maximum value of
+// strlen_t.
+#define STRING_NOT_FOUND ((strlen_t )~(strlen_t )0U)
+
 
 /*
 * Initialization functions
@@ -81,12 +142,17 @@ typedef struct {
 // Initialize a new string. All fields are assumed to contain junk so no
 // memory is free()d and new memory is allocated for contents if STRINGS_USE_MALLOC
 // is set.
+// Returns NULL if that allocation fails.
 string_t* string_init(string_t *s);
 //
 // Clear an existing string
 string_t* string_clear(string_t *s);
 //
 // Allocate and initialize a new string_t structure
+// When STRINGS_USE_SHARING is set, string_new_from_string() shares the
+// source's buffer the same way as string_share().
+// Returns NULL if allocation fails. If only the room for the copied contents
+// can't be allocated, they're truncated to fit.
 #if STRINGS_USE_MALLOC
 string_t* string_new(void);
 string_t* string_new_from_string(const string_t *s);
@@ -111,6 +177,50 @@ void string_free_void(void *ptr);
 #endif
 
 
+/*
+* Allocation functions
+* These do nothing unless STRINGS_USE_MALLOC is set.
+*/
+// Make room for a string of at least size characters (excluding the trailing
+// NUL) so that it can be built up without being re-allocated along the way.
+// size is limited to STRING_MAX_BYTES.
+string_t* string_reserve(string_t *s, strlen_t size);
+//
+// Release any allocated space not needed by the current contents.
+string_t* string_shrink_to_fit(string_t *s);
+
+
+/*
+* Arena functions
+* Strings bound to an arena take their contents from it rather than from
+* malloc(). When the arena is reset, every string bound to it (and every
+* string_t allocated from it) becomes invalid at once and must be
+* re-initialized before it's used again.
+* Arenas aren't thread-safe.
+*/
+#if STRINGS_USE_ARENAS
+// Initialize an arena to hand out the size bytes starting at buf, which
+// may come from halloc(), malloc(), or static storage.
+string_arena_t* string_arena_init(string_arena_t *a, void *buf, size_t size);
+//
+// Release everything allocated from an arena.
+string_arena_t* string_arena_reset(string_arena_t *a);
+//
+// Report how many bytes of an arena are in use.
+size_t string_arena_used(const string_arena_t *a);
+//
+// Initialize a string bound to an arena.
+// Returns NULL if the arena is too full to hold the string's initial buffer.
+string_t* string_init_in_arena(string_t *s, string_arena_t *a);
+//
+// Allocate and initialize a new string_t from an arena. string_free() may be
+// used on the result but isn't needed; it never calls free() for memory
+// that came from an arena.
+// Returns NULL if the arena is full.
+string_t* string_new_in_arena(string_arena_t *a);
+#endif // STRINGS_USE_ARENAS
+
+
 /*
 * Setting functions
 * Setting functions will copy in as much as will fit, and truncate the
@@ -121,6 +231,13 @@ string_t* string_set_from_cstring(string_t *restrict s, const char *restrict c,
 string_t* string_set_from_string(string_t *restrict s, const string_t *restrict src);
 string_t* string_printf(string_t *restrict s, const char *restrict format, ...)
 	__attribute__ ((format(printf, 2, 3)));
+//
+// Set dest to the same contents as src by sharing src's buffer rather than
+// copying it. Nothing is copied until one of them is changed. Strings kept
+// in their internal buffer or bound to an arena are copied as usual.
+#if STRINGS_USE_SHARING
+string_t* string_share(string_t *restrict dest, const string_t *restrict src);
+#endif
 
 
 /*
@@ -149,6 +266,11 @@ string_t* string_append_from_int_div(string_t *s, int n, int d);
 //
 // Append c to string until it's size characters long
 string_t* string_pad_from_char(string_t *s, char c, strlen_t size);
+//
+// Append src with every non-overlapping occurrence of from replaced by to,
+// scanning left to right.
+// None of the views may point into s.
+string_t* string_append_replace_all(string_t *restrict s, strview_t src, strview_t from, strview_t to);
 
 
 /*
@@ -158,11 +280,36 @@ string_t* string_pad_from_char(string_t *s, char c, strlen_t size);
 // Returns true if s->length == 0 or s == NULL
 bool string_is_empty(const string_t *s);
 //
+// Check whether a string's buffer is currently shared with another string.
+// Always false unless STRINGS_USE_SHARING is set.
+bool string_is_shared(const string_t *s);
+//
 // Check whether a string is the same a cstring
 bool string_eq_cstring(const string_t *l, const char *r);
 //
 // Check whether a string is the same another string
+// Strings of different lengths or with different cached hashes are
+// rejected without looking at their contents.
 bool string_eq_string(const string_t *l, const string_t *r);
+//
+// Compare two strings like strcmp(), with a shorter string ordered before a
+// longer one with the same prefix.
+int string_cmp_string(const string_t *l, const string_t *r);
+//
+// Return the hash of a string's contents, the same as strview_hash() would.
+// When STRINGS_CACHE_HASH is set the result is kept until the string changes.
+uint32_t string_hash(string_t *s);
+//
+// Forget a string's cached hash. This is only needed after changing the
+// contents directly.
+INLINE void string_invalidate_hash(string_t *s) {
+#if STRINGS_CACHE_HASH
+	s->hash = 0;
+#else
+	UNUSED(s);
+#endif
+	return;
+}
 
 
 /*
@@ -204,6 +351,75 @@ string_t* string_strip_leading(string_t *s, char c);
 //
 // Truncate a string to l characters
 string_t* string_truncate(string_t *s, const strlen_t l);
+//
+// Replace every non-overlapping occurrence of from with to in place,
+// scanning left to right. The string is truncated if the result is too long.
+// Neither view may point into s.
+string_t* string_replace_all(string_t *s, strview_t from, strview_t to);
+
+
+/*
+* String view functions
+* These never allocate or modify the underlying characters; each returns a
+* view into the same memory as the one passed to it, except that views of
+* "." may point to a static string.
+*/
+// Create a view of a whole string.
+strview_t strview_from_string(const string_t *s);
+//
+// Create a view of a cstring. If len is 0, strlen() is used.
+strview_t strview_from_cstring(const char *c, strlen_t len);
+//
+// Return len characters starting at start, clipped to the end of the view.
+strview_t strview_slice(strview_t v, strlen_t start, strlen_t len);
+//
+// Remove all leading and/or trailing instances of c from the view.
+strview_t strview_trim_char(strview_t v, char c);
+strview_t strview_strip_leading(strview_t v, char c);
+strview_t strview_strip_trailing(strview_t v, char c);
+//
+// Return the view of the first token in *v, which may be empty, and advance
+// *v past the sep character that ended it.
+// Repeating separators are *NOT* treated as a single one.
+// Parsing is done when *v is empty.
+strview_t strview_pop_token(strview_t *v, char sep);
+//
+// The same as strview_pop_token(), but the separator is a string.
+// If delim is empty, the whole view is returned.
+strview_t strview_pop_delim(strview_t *v, strview_t delim);
+//
+// Split a view on each occurrence of delim the same way as
+// strview_pop_delim(), storing at most max_parts pieces in ret_parts.
+// If there are more, the last one holds the rest of the view.
+// If ret_parts is NULL, the pieces are only counted.
+// Returns the number of pieces.
+strlen_t strview_split(strview_t v, strview_t delim, strview_t *ret_parts, strlen_t max_parts);
+//
+// Return the position of the first c or the first occurrence of needle in
+// a view, or STRING_NOT_FOUND. An empty needle is found at position 0.
+strlen_t strview_find_char(strview_t v, char c);
+strlen_t strview_find(strview_t v, strview_t needle);
+//
+// The same as string_dirname() and string_basename().
+strview_t strview_dirname(strview_t v, char sep);
+strview_t strview_basename(strview_t v, char sep);
+//
+// Check whether two views or a view and a cstring hold the same characters.
+bool strview_eq(strview_t l, strview_t r);
+bool strview_eq_cstring(strview_t l, const char *r);
+//
+// Compare two views like strcmp(), with a shorter view ordered before a
+// longer one with the same prefix.
+int strview_cmp(strview_t l, strview_t r);
+//
+// Hash the characters in a view (32-bit FNV-1a). Views holding the same
+// characters always hash the same.
+uint32_t strview_hash(strview_t v);
+//
+// Copy a view into a string.
+// The view may point into the string itself, such as a slice of it.
+string_t* string_set_from_strview(string_t *s, strview_t v);
+string_t* string_append_from_strview(string_t *s, strview_t v);
 
 #endif // ULIB_ENABLE_STRINGS
 #endif // _ULIB_STRINGS_H
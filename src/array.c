@@ -157,7 +157,7 @@ array_t* array_append(array_t *a, void *object) {
 # elif ARRAY_GROW_METHOD == ARRAY_GROW_MUL
 		add = CLIP_UMUL(a->allocated, ARRAY_GROW_FACTOR-1, ARRAY_MAX_OBJECTS);
 # elif ARRAY_GROW_METHOD == ARRAY_GROW_FRAC
-		add = (b->allocated / BUFFER_GROW_FACTOR);
+		add = (a->allocated / ARRAY_GROW_FACTOR);
 # elif ARRAY_GROW_METHOD == ARRAY_GROW_NONE
 		add = 0;
 # else
@@ -169,6 +169,15 @@ array_t* array_append(array_t *a, void *object) {
 		if ((new_size = CLIP_UADD(a->allocated, add, (arlen_t )ARRAY_MAX_OBJECTS)) == a->allocated) {
 			return a;
 		}
+# if ARRAY_MAX_OBJECTS > (SIZE_MAX / 16U)
+		// The size of the bank in bytes could overflow.
+		if (new_size > (SIZE_MAX / sizeof(*a->bank))) {
+			new_size = (arlen_t )(SIZE_MAX / sizeof(*a->bank));
+			if (new_size <= a->allocated) {
+				return a;
+			}
+		}
+# endif
 		if ((tmp = realloc(a->bank, new_size * sizeof(*a->bank))) == NULL) {
 			return a;
 		}
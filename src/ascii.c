@@ -28,12 +28,18 @@
 //    larger code for a single continuous range (e.g. '0-9 && a-f' vs '0-9')
 //    but the difference isn't always substantial
 //
+//    With ASCII_USE_CLASS_TABLE set, the tests are a single load and mask
+//    instead. ascii_classify_block() packs a block's results into one word
+//    so callers can find the first byte outside a class without testing each
+//    byte separately; the input is still read a byte at a time.
+//
 //
 #include "ascii.h"
 #if ULIB_ENABLE_ASCII
 #if ! ASCII_SUBSTITUTE_WITH_CTYPE
 
 #include "debug.h"
+#include "util.h"
 
 #if DO_ASCII_SAFETY_CHECKS
 # define ASCII_VALIDATE_INPUT(_c_) \
@@ -53,6 +59,96 @@ bool ascii_is_valid(uint_t c) {
 	return (c < 0x80U);
 }
 
+#if ASCII_USE_CLASS_TABLE
+#define CN ASCII_CLASS_CNTRL
+#define SP ASCII_CLASS_SPACE
+#define BL ASCII_CLASS_BLANK
+#define DI ASCII_CLASS_DIGIT
+#define UP ASCII_CLASS_UPPER
+#define LO ASCII_CLASS_LOWER
+#define HX ASCII_CLASS_HEX
+#define PU ASCII_CLASS_PUNCT
+// Codes from 0x80 up are left 0 so they don't belong to any class.
+FMEM_STORAGE const uint8_t ascii_class_table[256] = {
+	/* 0x00 */ CN,       CN,       CN,       CN,       CN,       CN,       CN,       CN,
+	/* 0x08 */ CN,       CN|SP|BL, CN|SP,    CN|SP,    CN|SP,    CN|SP,    CN,       CN,
+	/* 0x10 */ CN,       CN,       CN,       CN,       CN,       CN,       CN,       CN,
+	/* 0x18 */ CN,       CN,       CN,       CN,       CN,       CN,       CN,       CN,
+	/* 0x20 */ SP|BL,    PU,       PU,       PU,       PU,       PU,       PU,       PU,
+	/* 0x28 */ PU,       PU,       PU,       PU,       PU,       PU,       PU,       PU,
+	/* 0x30 */ DI,       DI,       DI,       DI,       DI,       DI,       DI,       DI,
+	/* 0x38 */ DI,       DI,       PU,       PU,       PU,       PU,       PU,       PU,
+	/* 0x40 */ PU,       UP|HX,    UP|HX,    UP|HX,    UP|HX,    UP|HX,    UP|HX,    UP,
+	/* 0x48 */ UP,       UP,       UP,       UP,       UP,       UP,       UP,       UP,
+	/* 0x50 */ UP,       UP,       UP,       UP,       UP,       UP,       UP,       UP,
+	/* 0x58 */ UP,       UP,       UP,       PU,       PU,       PU,       PU,       PU,
+	/* 0x60 */ PU,       LO|HX,    LO|HX,    LO|HX,    LO|HX,    LO|HX,    LO|HX,    LO,
+	/* 0x68 */ LO,       LO,       LO,       LO,       LO,       LO,       LO,       LO,
+	/* 0x70 */ LO,       LO,       LO,       LO,       LO,       LO,       LO,       LO,
+	/* 0x78 */ LO,       LO,       LO,       PU,       PU,       PU,       PU,       CN,
+};
+#undef CN
+#undef SP
+#undef BL
+#undef DI
+#undef UP
+#undef LO
+#undef HX
+#undef PU
+
+uint32_t ascii_classify_block(const char *buf, uint_fast8_t len, uint8_t classes) {
+	uint32_t bits = 0;
+
+	ulib_assert(POINTER_IS_VALID(buf) || (len == 0));
+	ulib_assert(len <= ASCII_BLOCK_BYTES);
+
+#if DO_ASCII_SAFETY_CHECKS
+	if (buf == NULL) {
+		return 0;
+	}
+	if (len > ASCII_BLOCK_BYTES) {
+		len = ASCII_BLOCK_BYTES;
+	}
+#endif
+
+	for (uint_fast8_t i = 0; i < len; ++i) {
+		uint32_t in_class = ((ascii_class_table[(uint8_t )buf[i]] & classes) != 0U);
+
+		bits |= (uint32_t )(in_class << i);
+	}
+
+	return bits;
+}
+size_t ascii_span(const char *buf, size_t len, uint8_t classes) {
+	size_t i = 0;
+
+	ulib_assert(POINTER_IS_VALID(buf) || (len == 0));
+
+#if DO_ASCII_SAFETY_CHECKS
+	if (buf == NULL) {
+		return 0;
+	}
+#endif
+
+	while (i < len) {
+		uint_fast8_t n = (uint_fast8_t )MIN(len - i, ASCII_BLOCK_BYTES);
+		uint32_t bits = ascii_classify_block(&buf[i], n, classes);
+
+		// Count the bytes before the first one outside the classes.
+		for (; (bits & 1U) != 0; bits >>= 1U) {
+			++i;
+			--n;
+		}
+		if (n != 0) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+#else // ! ASCII_USE_CLASS_TABLE
+
 bool ascii_is_cntrl(uint8_t c) {
 	ASCII_VALIDATE_INPUT(c);
 
@@ -196,6 +292,7 @@ bool ascii_is_upper(uint8_t c) {
 
 	return (c >= 'A' && c <= 'Z');
 }
+#endif // ASCII_USE_CLASS_TABLE
 
 //
 // These functions modify codes
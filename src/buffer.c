@@ -161,10 +161,11 @@ buflen_t buffer_grow(buffer_t *b, buflen_t add) {
 	}
 #else // !BUFFERS_USE_MALLOC
 	UNUSED(add);
-	new_size = old_size;
+	UNUSED(new_size);
 #endif
 
-	return new_size - old_size;
+	// The allocation may have failed, so report what was actually gained.
+	return b->allocated - old_size;
 }
 
 
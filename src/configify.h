@@ -31,6 +31,10 @@
 #endif
 #include ULIB_CONFIG_HEADER
 
+#if ULIB_LARGE_LIMITS && ! ULIB_USE_MALLOC
+# error "ULIB_LARGE_LIMITS requires ULIB_USE_MALLOC"
+#endif
+
 #if ULIB_BITOP_ENABLE_GENERICS
 # if ! ULIB_BITOP_ENABLE_INLINED_64BIT_FUNCTIONS
 #  undef ULIB_BITOP_ENABLE_INLINED_64BIT_FUNCTIONS
@@ -39,6 +43,14 @@
 # endif
 #endif
 
+#if ULIB_ENABLE_ASCII && ASCII_USE_CLASS_TABLE && ! ASCII_SUBSTITUTE_WITH_CTYPE
+# if !ULIB_ENABLE_FMEM
+#  undef ULIB_ENABLE_FMEM
+#  define ULIB_ENABLE_FMEM 1
+#  pragma message "Enabling FMEM module for ASCII module."
+# endif
+#endif
+
 #if ULIB_ENABLE_GETOPT
 # if !ULIB_ENABLE_CSTRINGS
 #  undef ULIB_ENABLE_CSTRINGS
@@ -52,6 +64,14 @@
 # endif
 #endif
 
+#if ULIB_ENABLE_INTERN
+# if !ULIB_ENABLE_STRINGS
+#  undef ULIB_ENABLE_STRINGS
+#  define ULIB_ENABLE_STRINGS 1
+#  pragma message "Enabling STRINGS module for INTERN module."
+# endif
+#endif
+
 #if ULIB_ENABLE_MSG
 # if !ULIB_ENABLE_CSTRINGS
 #  undef ULIB_ENABLE_CSTRINGS
@@ -65,6 +85,38 @@
 # endif
 #endif
 
+#if ULIB_ENABLE_PRINTF
+# if !ULIB_ENABLE_CSTRINGS
+#  undef ULIB_ENABLE_CSTRINGS
+#  define ULIB_ENABLE_CSTRINGS 1
+#  pragma message "Enabling CSTRINGS module for PRINTF module."
+# endif
+#endif
+
+#if ULIB_ENABLE_ROPE
+# if !ULIB_ENABLE_STRINGS
+#  undef ULIB_ENABLE_STRINGS
+#  define ULIB_ENABLE_STRINGS 1
+#  pragma message "Enabling STRINGS module for ROPE module."
+# endif
+#endif
+
+#if ULIB_ENABLE_STRINGS
+# if !ULIB_ENABLE_CSTRINGS
+#  undef ULIB_ENABLE_CSTRINGS
+#  define ULIB_ENABLE_CSTRINGS 1
+#  pragma message "Enabling CSTRINGS module for STRINGS module."
+# endif
+#endif
+
+#if ULIB_ENABLE_CSTRINGS
+# if !ULIB_ENABLE_FMEM
+#  undef ULIB_ENABLE_FMEM
+#  define ULIB_ENABLE_FMEM 1
+#  pragma message "Enabling FMEM module for CSTRINGS module."
+# endif
+#endif
+
 #if ULIB_ENABLE_FILES
 # if !ULIB_ENABLE_MATH
 #  undef ULIB_ENABLE_MATH
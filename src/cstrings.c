@@ -20,16 +20,43 @@
 // cstrings.c
 // Tools for dealing with C-style strings
 // NOTES:
+//   Searching leans on memchr() because the C library's version is usually
+//   vectorized, which is more than can be done here portably.
 //
+//   For the same reason, functions that rewrite a string in place find its
+//   end with strlen() and then work over a counted, branchless loop that the
+//   compiler is able to vectorize. Reading a word at a time directly would
+//   break strict aliasing and risk reading past the end of the string's page.
+//   GCC only vectorizes them at -O3 or with -fvect-cost-model=cheap; plain
+//   -O2 leaves them as branchless byte loops.
 //
+//   Decimal parsing converts 8 digits per step once it's known that many
+//   bytes are available, treating them as a 64-bit integer. The bytes are
+//   combined with shifts rather than by casting the pointer, which keeps it
+//   independent of alignment, aliasing, and byte order; compilers merge the
+//   shifts into a single load where they can.
+//
+//   memmem() is only declared by glibc when _GNU_SOURCE is set, which would
+//   have to happen before the configuration is read since that may include
+//   system headers. It's declared here instead when CSTRINGS_USE_MEMMEM is set.
+//
+//
+
 #include "cstrings.h"
 #if ULIB_ENABLE_CSTRINGS
 
 #include "ascii.h"
 #include "debug.h"
+#include "fmem.h"
+#include "util.h"
 
+#include <limits.h>
 #include <string.h>
 
+#if CSTRINGS_USE_MEMMEM && !defined(_GNU_SOURCE)
+void* memmem(const void *hay, size_t hay_len, const void *needle, size_t needle_len);
+#endif
+
 bool cstring_eq(const char *s1, const char *s2) {
 	ulib_assert(s1 != NULL);
 	ulib_assert(s2 != NULL);
@@ -52,6 +79,47 @@ bool cstring_eqn(const char *s1, const char *s2, uint_t n) {
 #endif
 	return (strncmp(s1, s2, n) == 0);
 }
+const char* cstring_find(const char *hay, size_t hay_len, const char *needle, size_t needle_len) {
+	ulib_assert(POINTER_IS_VALID(hay) || (hay_len == 0));
+	ulib_assert(POINTER_IS_VALID(needle) || (needle_len == 0));
+
+#if DO_CSTRING_SAFETY_CHECKS
+	if ((hay == NULL) || ((needle == NULL) && (needle_len != 0))) {
+		return NULL;
+	}
+#endif
+
+	if (needle_len == 0) {
+		return hay;
+	}
+	if (needle_len > hay_len) {
+		return NULL;
+	}
+
+#if CSTRINGS_USE_MEMMEM
+	return memmem(hay, hay_len, needle, needle_len);
+#else
+	{
+		// One past the last place needle could start.
+		const char *end = &hay[(hay_len - needle_len) + 1U];
+		size_t last = needle_len - 1U;
+
+		// Skip to each candidate's first byte with memchr() and check its last
+		// byte before comparing the rest, which rejects most false starts
+		// cheaply.
+		for (const char *p = hay; p < end; ++p) {
+			if ((p = memchr(p, needle[0], (size_t )(end - p))) == NULL) {
+				break;
+			}
+			if ((p[last] == needle[last]) && (memcmp(&p[1], &needle[1], last) == 0)) {
+				return p;
+			}
+		}
+	}
+
+	return NULL;
+#endif
+}
 bool cstring_eqz(const char *s1, const char *s2) {
 	ulib_assert(s1 != NULL);
 	ulib_assert(s2 != NULL);
@@ -193,9 +261,19 @@ const char* cstring_basename(const char *s) {
 
 	return bn;
 }
-char *cstring_to_upper(char *s) {
-	uint8_t *c;
+// Flip the case bit of every byte between first and first+25 inclusive.
+static void flip_case(uint8_t *c, size_t len, uint8_t first) {
+	for (size_t i = 0; i < len; ++i) {
+		// The subtraction wraps for anything below first, so there's only
+		// one comparison and no branch.
+		uint8_t in_range = (uint8_t )((uint8_t )(c[i] - first) < 26U);
+
+		c[i] = (uint8_t )(c[i] ^ (uint8_t )(in_range << 5U));
+	}
 
+	return;
+}
+char *cstring_to_upper(char *s) {
 	ulib_assert(s != NULL);
 
 #if DO_CSTRING_SAFETY_CHECKS
@@ -204,15 +282,11 @@ char *cstring_to_upper(char *s) {
 	}
 #endif
 
-	for (c = (uint8_t *)s; *c != 0; ++c) {
-		*c = ASCII_TO_UPPER(*c);
-	}
+	flip_case((uint8_t *)s, strlen(s), 'a');
 
 	return s;
 }
 char *cstring_to_lower(char *s) {
-	uint8_t *c;
-
 	ulib_assert(s != NULL);
 
 #if DO_CSTRING_SAFETY_CHECKS
@@ -221,9 +295,7 @@ char *cstring_to_lower(char *s) {
 	}
 #endif
 
-	for (c = (uint8_t *)s; *c != 0; ++c) {
-		*c = ASCII_TO_LOWER(*c);
-	}
+	flip_case((uint8_t *)s, strlen(s), 'A');
 
 	return s;
 }
@@ -237,10 +309,77 @@ char *cstring_tr(char *s, char old, char new) {
 	}
 #endif
 
-	CSTRING_TR(s, old, new);
+	// Every byte is written back whether it changed or not so that the loop
+	// has no branch.
+	for (size_t i = 0, len = strlen(s); i < len; ++i) {
+		s[i] = (s[i] == old) ? new : s[i];
+	}
+
 	return s;
 }
 
+// Every two-digit decimal number in order, so that the pair for n is at
+// digit_pairs[n*2].
+// The pairs are copied a byte at a time because memcpy() can't read from
+// FMEM_STORAGE; compilers merge the two into one load where they can.
+static FMEM_STORAGE const char digit_pairs[200] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+// n/100 for any 32-bit n; 0x51EB851F is 2^37/100 rounded up. This is what a
+// good compiler does on its own, but not every target gets a good compiler.
+#define DIV100(_n_) ((uint32_t )(((uint64_t )(_n_) * 0x51EB851FU) >> 37U))
+
+char* cstring_from_uint32_end(char *end, uint32_t n) {
+	ulib_assert(end != NULL);
+
+	while (n >= 100U) {
+		uint32_t q = DIV100(n);
+		uint_fast8_t r = (uint_fast8_t )(n - (q * 100U));
+
+		end -= 2;
+		end[0] = digit_pairs[r * 2U];
+		end[1] = digit_pairs[(r * 2U) + 1U];
+		n = q;
+	}
+	if (n >= 10U) {
+		end -= 2;
+		end[0] = digit_pairs[n * 2U];
+		end[1] = digit_pairs[(n * 2U) + 1U];
+	} else {
+		*--end = (char )('0' + n);
+	}
+
+	return end;
+}
+char* cstring_from_uint64_end(char *end, uint64_t n) {
+	ulib_assert(end != NULL);
+
+	// Peel off 8 digits at a time until the rest fits in 32 bits; that takes
+	// at most two 64-bit divisions.
+	while (n > UINT32_MAX) {
+		uint64_t q = n / 100000000U;
+		uint32_t r = (uint32_t )(n - (q * 100000000U));
+		char *start = cstring_from_uint32_end(end, r);
+
+		end -= 8;
+		while (start > end) {
+			*--start = '0';
+		}
+		n = q;
+	}
+
+	return cstring_from_uint32_end(end, (uint32_t )n);
+}
+
 uint_t cstring_from_uint(char *dest, uint_t size, uint_t src, uint_t base) {
 	uint_t i = 0, w = 0;
 
@@ -254,10 +393,30 @@ uint_t cstring_from_uint(char *dest, uint_t size, uint_t src, uint_t base) {
 	}
 #endif
 
+	if (base == 10) {
+		char buf[CSTRING_UINT64_DIGITS];
+		char *end = &buf[SIZEOF_ARRAY(buf)];
+		char *start;
+
+#if UINT_MAX > UINT32_MAX
+		start = cstring_from_uint64_end(end, src);
+#else
+		start = cstring_from_uint32_end(end, src);
+#endif
+		w = (uint_t )(end - start);
+		if (w < size) {
+			memcpy(dest, start, w);
+			dest[w] = 0;
+		}
+
+		return w;
+	}
+
 	if (src == 0) {
 		w = 1;
 	} else {
-		for (uint_t x = 1; x <= src; x *= base, ++w) {
+		// Counting down avoids overflowing when src is near UINT_MAX.
+		for (uint_t x = src; x != 0; x /= base, ++w) {
 			// Nothing to do here
 		}
 	}
@@ -277,6 +436,186 @@ uint_t cstring_from_uint(char *dest, uint_t size, uint_t src, uint_t base) {
 	return w;
 }
 
+// Combine 8 bytes into an integer with s[0] in the lowest byte.
+// This is written out rather than looped so that the compiler recognizes
+// it as a load.
+static uint64_t load_eight_bytes(const char *s) {
+	return (
+		((uint64_t )(uint8_t )s[0]) |
+		((uint64_t )(uint8_t )s[1] << 8U) |
+		((uint64_t )(uint8_t )s[2] << 16U) |
+		((uint64_t )(uint8_t )s[3] << 24U) |
+		((uint64_t )(uint8_t )s[4] << 32U) |
+		((uint64_t )(uint8_t )s[5] << 40U) |
+		((uint64_t )(uint8_t )s[6] << 48U) |
+		((uint64_t )(uint8_t )s[7] << 56U)
+	);
+}
+// Check whether all 8 bytes loaded by load_eight_bytes() are '0'-'9'.
+static bool is_eight_digits(uint64_t w) {
+	// A byte is a digit if its high nibble is 3 both before and after
+	// adding 6.
+	uint64_t high = w & 0xF0F0F0F0F0F0F0F0ULL;
+	uint64_t added = ((w + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4U;
+
+	return ((high | added) == 0x3333333333333333ULL);
+}
+// Convert 8 digits loaded by load_eight_bytes() to their value.
+static uint32_t parse_eight_digits(uint64_t w) {
+	const uint64_t mask = 0x000000FF000000FFULL;
+	const uint64_t mul1 = 100ULL + (1000000ULL << 32U);
+	const uint64_t mul2 = 1ULL + (10000ULL << 32U);
+
+	// Combine adjacent digits into pairs, then pairs into the two halves
+	// of the number in the upper 32 bits.
+	w -= 0x3030303030303030ULL;
+	w = (w * 10U) + (w >> 8U);
+	return (uint32_t )((((w & mask) * mul1) + (((w >> 16U) & mask) * mul2)) >> 32U);
+}
+// Return the value of a base 16 digit, or 0xFF if c isn't one.
+static uint_fast8_t digit_value(char c) {
+	uint8_t u = (uint8_t )c;
+
+	if ((u >= '0') && (u <= '9')) {
+		return (uint_fast8_t )(u - '0');
+	}
+	u |= 0x20U;
+	if ((u >= 'a') && (u <= 'f')) {
+		return (uint_fast8_t )(u - 'a' + 10U);
+	}
+
+	return 0xFFU;
+}
+// Parse the digits at the start of s, stopping before the value would exceed
+// limit.
+// Returns the number of digits consumed.
+static size_t parse_digits(const char *s, size_t len, uint_fast8_t base, uint64_t limit, uint64_t *ret_value, bool *ret_overflow) {
+	uint64_t value = 0, cutoff;
+	bool overflow = false;
+	size_t i = 0;
+
+	// Dividing once up front keeps division out of the loops; value can be
+	// multiplied without overflowing as long as it's no more than cutoff.
+	if ((base == 10U) && (len >= 8U)) {
+		cutoff = limit / 100000000U;
+		for (; (len - i) >= 8U; i += 8U) {
+			uint64_t w = load_eight_bytes(&s[i]);
+			uint32_t chunk;
+
+			if (!is_eight_digits(w)) {
+				break;
+			}
+			chunk = parse_eight_digits(w);
+			if (overflow || (value > cutoff) || (chunk > (limit - (value * 100000000U)))) {
+				overflow = true;
+			} else {
+				value = (value * 100000000U) + chunk;
+			}
+		}
+	}
+	// Only two bases are supported, so spell them out to let the compiler
+	// turn the division into a multiplication.
+	cutoff = (base == 10U) ? (limit / 10U) : (limit / 16U);
+	for (; i < len; ++i) {
+		uint_fast8_t d = digit_value(s[i]);
+
+		if (d >= base) {
+			break;
+		}
+		if (overflow || (value > cutoff) || (d > (limit - (value * base)))) {
+			overflow = true;
+		} else {
+			value = (value * base) + d;
+		}
+	}
+
+	*ret_value = (overflow) ? limit : value;
+	*ret_overflow = overflow;
+	return i;
+}
+bool cstring_to_uint64(const char *s, size_t len, uint_fast8_t base, uint64_t *ret_value, const char **ret_end) {
+	uint64_t value = 0;
+	bool overflow = false;
+	size_t n = 0;
+
+	ulib_assert(s != NULL);
+	ulib_assert((base == 10U) || (base == 16U));
+	ulib_assert(ret_value != NULL);
+
+#if DO_CSTRING_SAFETY_CHECKS
+	if ((s == NULL) || (ret_value == NULL)) {
+		return false;
+	}
+	if ((base != 10U) && (base != 16U)) {
+		*ret_value = 0;
+		if (ret_end != NULL) {
+			*ret_end = s;
+		}
+		return false;
+	}
+#endif
+
+	if (len == 0) {
+		len = strlen(s);
+	}
+	n = parse_digits(s, len, base, UINT64_MAX, &value, &overflow);
+
+	*ret_value = value;
+	if (ret_end != NULL) {
+		*ret_end = &s[n];
+	}
+	return ((n > 0) && !overflow);
+}
+bool cstring_to_int64(const char *s, size_t len, uint_fast8_t base, int64_t *ret_value, const char **ret_end) {
+	uint64_t mag = 0;
+	int64_t value;
+	bool neg = false, overflow = false;
+	size_t i = 0, n = 0;
+
+	ulib_assert(s != NULL);
+	ulib_assert((base == 10U) || (base == 16U));
+	ulib_assert(ret_value != NULL);
+
+#if DO_CSTRING_SAFETY_CHECKS
+	if ((s == NULL) || (ret_value == NULL)) {
+		return false;
+	}
+	if ((base != 10U) && (base != 16U)) {
+		*ret_value = 0;
+		if (ret_end != NULL) {
+			*ret_end = s;
+		}
+		return false;
+	}
+#endif
+
+	if (len == 0) {
+		len = strlen(s);
+	}
+	if ((len > 0) && ((s[0] == '-') || (s[0] == '+'))) {
+		neg = (s[0] == '-');
+		i = 1;
+	}
+	// The magnitude of INT64_MIN is one more than INT64_MAX.
+	n = parse_digits(&s[i], len - i, base, (uint64_t )INT64_MAX + (neg ? 1U : 0U), &mag, &overflow);
+
+	if (n == 0) {
+		value = 0;
+		i = 0;
+	} else if (neg) {
+		// Negating INT64_MIN's magnitude directly would overflow.
+		value = (mag == 0) ? 0 : (-(int64_t )(mag - 1U) - 1);
+	} else {
+		value = (int64_t )mag;
+	}
+
+	*ret_value = value;
+	if (ret_end != NULL) {
+		*ret_end = &s[i + n];
+	}
+	return ((n > 0) && !overflow);
+}
+
 #else
 	// ISO C forbids empty translation units, this makes it happy.
 	typedef int make_iso_compilers_happy;
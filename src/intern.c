@@ -0,0 +1,427 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/***********************************************************************
+*                                                                      *
+*                                                                      *
+* Copyright 2024 svijsv                                                *
+* This program is free software: you can redistribute it and/or modify *
+* it under the terms of the GNU General Public License as published by *
+* the Free Software Foundation, version 3.                             *
+*                                                                      *
+* This program is distributed in the hope that it will be useful, but  *
+* WITHOUT ANY WARRANTY; without even the implied warranty of           *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+* General Public License for more details.                             *
+*                                                                      *
+* You should have received a copy of the GNU General Public License    *
+* along with this program. If not, see <http:// www.gnu.org/licenses/>.*
+*                                                                      *
+*                                                                      *
+***********************************************************************/
+// intern.c
+// Keep a single canonical copy of each distinct string
+//
+// NOTES:
+//   The table is open-addressed with linear probing and is never more than
+//   3/4 full. Since nothing is ever removed there are no tombstones to deal
+//   with, and the stored hashes mean growing never has to re-hash strings.
+//
+//   Interned strings are packed into blocks of INTERN_BLOCK_BYTES rather than
+//   being allocated one by one. A string too big for a block gets a block of
+//   its own, which is linked in behind the current one so that the space
+//   left in that isn't abandoned.
+//
+//
+#include "intern.h"
+#if ULIB_ENABLE_INTERN
+
+#include "debug.h"
+#include "strings.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#if ! ULIB_USE_MALLOC
+# error "The INTERN module requires ULIB_USE_MALLOC"
+#endif
+#if INTERN_BLOCK_BYTES < 64
+# error "INTERN_BLOCK_BYTES < 64"
+#endif
+#if INTERN_MIN_SLOTS < 4 || (INTERN_MIN_SLOTS & (INTERN_MIN_SLOTS - 1U)) != 0
+# error "INTERN_MIN_SLOTS must be a power of 2 no less than 4"
+#endif
+
+// Alignment of interned_t structures within a block.
+#define ENTRY_ALIGNMENT (MAX(sizeof(uint32_t), sizeof(strlen_t)))
+
+// The largest number of slots the table is allowed to grow to.
+#define MAX_SLOTS (0x80000000U)
+
+typedef struct intern_block_t {
+	struct intern_block_t *next;
+	size_t size;
+	size_t used;
+	char data[];
+} intern_block_t;
+
+#define ASSERT_TABLE(t) ulib_assert(POINTER_IS_VALID(t))
+#define ASSERT_VIEW(v) ulib_assert(((v).ptr != NULL) || ((v).length == 0))
+
+
+#if INTERN_USE_LOCKING
+static void lock_table(intern_table_t *t) {
+	while (__atomic_test_and_set(&t->locked, __ATOMIC_ACQUIRE)) {
+		// Nothing to do here
+	}
+	return;
+}
+static void unlock_table(intern_table_t *t) {
+	__atomic_clear(&t->locked, __ATOMIC_RELEASE);
+	return;
+}
+#else
+# define lock_table(t)   ((void )0U)
+# define unlock_table(t) ((void )0U)
+#endif
+
+// Find the slot holding v, or the empty slot where it belongs.
+// The table must have at least one slot.
+static const interned_t** find_slot(const intern_table_t *t, strview_t v, uint32_t hash) {
+	uint32_t mask = t->slot_count - 1U;
+	uint32_t i = hash & mask;
+
+	while (t->slots[i] != NULL) {
+		const interned_t *h = t->slots[i];
+
+		if ((h->hash == hash) && (h->length == v.length) && ((v.length == 0) || (memcmp(h->cstring, v.ptr, v.length) == 0))) {
+			break;
+		}
+		i = (i + 1U) & mask;
+	}
+
+	return &t->slots[i];
+}
+// Resize the hash table to hold new_count slots, re-inserting everything.
+static bool resize_table(intern_table_t *t, uint32_t new_count) {
+	const interned_t **slots;
+	uint32_t mask = new_count - 1U;
+
+	if ((slots = calloc(new_count, sizeof(*slots))) == NULL) {
+		return false;
+	}
+	for (uint32_t i = 0; i < t->slot_count; ++i) {
+		const interned_t *h = t->slots[i];
+
+		if (h != NULL) {
+			uint32_t j;
+
+			for (j = h->hash & mask; slots[j] != NULL; j = (j + 1U) & mask) {
+				// Nothing to do here
+			}
+			slots[j] = h;
+		}
+	}
+	free(t->slots);
+	t->slots = slots;
+	t->slot_count = new_count;
+
+	return true;
+}
+// Make sure there's room for n more entries without exceeding the maximum
+// load factor.
+static bool reserve_slots(intern_table_t *t, uint32_t n) {
+	uint32_t new_count = (t->slot_count != 0) ? t->slot_count : INTERN_MIN_SLOTS;
+	uint64_t need = (uint64_t )t->count + n;
+
+	while ((need * 4U) > ((uint64_t )new_count * 3U)) {
+		if (new_count >= MAX_SLOTS) {
+			return false;
+		}
+		new_count *= 2U;
+	}
+	if (new_count != t->slot_count) {
+		return resize_table(t, new_count);
+	}
+
+	return true;
+}
+// Carve space for an entry out of the current block, adding a block if
+// there's not enough room.
+static interned_t* alloc_entry(intern_table_t *t, size_t size) {
+	intern_block_t *b = t->blocks;
+	size_t start = 0;
+
+	if (b != NULL) {
+		size_t rem = (size_t )((uintptr_t )(b->data + b->used) % ENTRY_ALIGNMENT);
+
+		start = b->used;
+		if (rem != 0) {
+			start += ENTRY_ALIGNMENT - rem;
+		}
+	}
+	if ((b == NULL) || (start > b->size) || (size > (b->size - start))) {
+		size_t block_size = MAX(size + ENTRY_ALIGNMENT, INTERN_BLOCK_BYTES - sizeof(*b));
+		intern_block_t *nb;
+
+		if ((nb = malloc(sizeof(*nb) + block_size)) == NULL) {
+			return NULL;
+		}
+		nb->size = block_size;
+		nb->used = 0;
+		t->block_bytes += sizeof(*nb) + block_size;
+
+		// Keep filling the current block if the new one's a one-off for
+		// a big string.
+		if ((b != NULL) && (block_size > (INTERN_BLOCK_BYTES - sizeof(*b)))) {
+			nb->next = b->next;
+			b->next = nb;
+		} else {
+			nb->next = b;
+			t->blocks = nb;
+		}
+		b = nb;
+
+		start = (size_t )(ENTRY_ALIGNMENT - ((uintptr_t )b->data % ENTRY_ALIGNMENT)) % ENTRY_ALIGNMENT;
+	}
+	b->used = start + size;
+
+	// Casting from char* is fine here because the memory came from malloc()
+	// and is only ever accessed as an interned_t.
+	return (interned_t *)(void *)(b->data + start);
+}
+// Intern a string with the table already locked.
+static const interned_t* intern_locked(intern_table_t *t, strview_t v, uint32_t hash) {
+	const interned_t **slot;
+	interned_t *h;
+	size_t size;
+
+	if (!reserve_slots(t, 1)) {
+		// The table may still have room for this if it's a duplicate or
+		// we're just at the maximum load factor.
+		if ((t->slot_count == 0) || (t->count >= (t->slot_count - 1U))) {
+			return NULL;
+		}
+	}
+	slot = find_slot(t, v, hash);
+	if (*slot != NULL) {
+		++t->duplicates;
+		t->saved_bytes += v.length + 1U;
+		return *slot;
+	}
+
+	size = sizeof(*h) + v.length + 1U;
+	if ((h = alloc_entry(t, size)) == NULL) {
+		return NULL;
+	}
+	h->hash = hash;
+	h->length = v.length;
+	if (v.length > 0) {
+		memcpy(h->cstring, v.ptr, v.length);
+	}
+	h->cstring[v.length] = 0;
+
+	*slot = h;
+	++t->count;
+	t->string_bytes += v.length + 1U;
+	t->entry_bytes += size;
+
+	return h;
+}
+// Intern a string whose hash is already known.
+static const interned_t* intern_hashed(intern_table_t *t, strview_t v, uint32_t hash) {
+	const interned_t *h;
+
+	lock_table(t);
+	h = intern_locked(t, v, hash);
+	unlock_table(t);
+
+	return h;
+}
+
+
+intern_table_t* intern_init(intern_table_t *t) {
+	ASSERT_TABLE(t);
+
+#if DO_INTERN_SAFETY_CHECKS
+	if (t == NULL) {
+		return NULL;
+	}
+#endif
+
+	mem_init(t, 0, sizeof(*t));
+
+	return t;
+}
+intern_table_t* intern_clear(intern_table_t *t) {
+	intern_block_t *b;
+
+	ASSERT_TABLE(t);
+
+#if DO_INTERN_SAFETY_CHECKS
+	if (t == NULL) {
+		return NULL;
+	}
+#endif
+
+	lock_table(t);
+	while ((b = t->blocks) != NULL) {
+		t->blocks = b->next;
+		free(b);
+	}
+	free(t->slots);
+	t->slots = NULL;
+	t->slot_count = 0;
+	t->count = 0;
+	t->string_bytes = 0;
+	t->entry_bytes = 0;
+	t->block_bytes = 0;
+	t->duplicates = 0;
+	t->saved_bytes = 0;
+	unlock_table(t);
+
+	return t;
+}
+
+const interned_t* intern_strview(intern_table_t *t, strview_t v) {
+	ASSERT_TABLE(t);
+	ASSERT_VIEW(v);
+
+#if DO_INTERN_SAFETY_CHECKS
+	if (t == NULL) {
+		return NULL;
+	}
+	if (v.ptr == NULL) {
+		v.length = 0;
+	}
+#endif
+
+	return intern_hashed(t, v, strview_hash(v));
+}
+const interned_t* intern_cstring(intern_table_t *t, const char *c, strlen_t len) {
+	ulib_assert(POINTER_IS_VALID(c));
+
+#if DO_INTERN_SAFETY_CHECKS
+	if (c == NULL) {
+		return NULL;
+	}
+#endif
+
+	return intern_strview(t, strview_from_cstring(c, len));
+}
+const interned_t* intern_string(intern_table_t *t, const string_t *s) {
+	strview_t v;
+
+	ASSERT_TABLE(t);
+	ulib_assert(POINTER_IS_VALID(s));
+
+#if DO_INTERN_SAFETY_CHECKS
+	if ((t == NULL) || (s == NULL)) {
+		return NULL;
+	}
+#endif
+
+	v = strview_from_string(s);
+#if STRINGS_CACHE_HASH
+	// Use the string's cached hash if it has one.
+	if (s->hash != 0) {
+		return intern_hashed(t, v, s->hash);
+	}
+#endif
+
+	return intern_hashed(t, v, strview_hash(v));
+}
+const interned_t* intern_find(intern_table_t *t, strview_t v) {
+	const interned_t *h = NULL;
+
+	ASSERT_TABLE(t);
+	ASSERT_VIEW(v);
+
+#if DO_INTERN_SAFETY_CHECKS
+	if (t == NULL) {
+		return NULL;
+	}
+	if (v.ptr == NULL) {
+		v.length = 0;
+	}
+#endif
+
+	lock_table(t);
+	if (t->slot_count != 0) {
+		h = *find_slot(t, v, strview_hash(v));
+	}
+	unlock_table(t);
+
+	return h;
+}
+uint32_t intern_bulk(intern_table_t *t, const strview_t *views, uint32_t count, const interned_t **ret_handles) {
+	uint32_t done = 0;
+
+	ASSERT_TABLE(t);
+	ulib_assert(POINTER_IS_VALID(views) || (count == 0));
+
+#if DO_INTERN_SAFETY_CHECKS
+	if ((t == NULL) || (views == NULL)) {
+		return 0;
+	}
+#endif
+
+	lock_table(t);
+	// If this fails the table still grows one entry at a time as needed.
+	reserve_slots(t, count);
+	for (uint32_t i = 0; i < count; ++i) {
+		const interned_t *h = NULL;
+
+		ASSERT_VIEW(views[i]);
+#if DO_INTERN_SAFETY_CHECKS
+		if ((views[i].ptr != NULL) || (views[i].length == 0)) {
+			h = intern_locked(t, views[i], strview_hash(views[i]));
+		}
+#else
+		h = intern_locked(t, views[i], strview_hash(views[i]));
+#endif
+		if (h != NULL) {
+			++done;
+		}
+		if (ret_handles != NULL) {
+			ret_handles[i] = h;
+		}
+	}
+	unlock_table(t);
+
+	return done;
+}
+
+intern_usage_t* intern_get_usage(intern_table_t *t, intern_usage_t *ret_usage) {
+	intern_usage_t usage;
+
+	ASSERT_TABLE(t);
+	ulib_assert(POINTER_IS_VALID(ret_usage));
+
+#if DO_INTERN_SAFETY_CHECKS
+	if ((t == NULL) || (ret_usage == NULL)) {
+		return ret_usage;
+	}
+#endif
+
+	lock_table(t);
+	usage.entries = t->count;
+	usage.slots = t->slot_count;
+	usage.string_bytes = t->string_bytes;
+	usage.entry_bytes = t->entry_bytes;
+	usage.block_bytes = t->block_bytes;
+	usage.table_bytes = t->slot_count * sizeof(*t->slots);
+	usage.duplicates = t->duplicates;
+	usage.saved_bytes = t->saved_bytes;
+	unlock_table(t);
+	usage.total_bytes = usage.block_bytes + usage.table_bytes;
+
+	*ret_usage = usage;
+
+	return ret_usage;
+}
+
+#else
+	// ISO C forbids empty translation units, this makes it happy.
+	typedef int make_iso_compilers_happy;
+#endif // ULIB_ENABLE_INTERN
@@ -22,14 +22,22 @@
 // NOTES:
 //
 //
+// fallocate() is a GNU extension; it's only used when preallocating log files
+// and is skipped if unavailable.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE 1
+#endif
+
 #include "msg.h"
 #if ULIB_ENABLE_MSG
 
 #include "bits.h"
 #include "cstrings.h"
 #include "debug.h"
+#include "util.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 
 #if MSG_USE_MALLOC
@@ -44,7 +52,12 @@
 
 #if MSG_USE_UNIX_IO
 # include <fcntl.h>
+# include <stdio.h>
+# include <sys/stat.h>
 # include <unistd.h>
+# if MSG_USE_RING_LOG
+#  include <sys/mman.h>
+# endif
 
 # if !defined(O_DIRECT)
 #  define O_DIRECT 0
@@ -52,6 +65,47 @@
 # if !defined(O_CLOEXEC)
 #  define O_CLOEXEC 0
 # endif
+
+# if MSG_LOG_TIME_USE_COARSE_CLOCK && defined(CLOCK_REALTIME_COARSE)
+#  define LOG_TIME_CLOCK CLOCK_REALTIME_COARSE
+# else
+#  define LOG_TIME_CLOCK CLOCK_REALTIME
+# endif
+#endif
+
+#if (MSG_LOG_TIME_SUBSEC_DIGITS < 0) || (MSG_LOG_TIME_SUBSEC_DIGITS > 9)
+# error "MSG_LOG_TIME_SUBSEC_DIGITS must be between 0 and 9"
+#endif
+#if !MSG_USE_MALLOC && (MSG_LOG_PATH_BYTES < 2)
+# error "MSG_LOG_PATH_BYTES < 2"
+#endif
+#if MSG_MODULE_COUNT > 256
+# error "MSG_MODULE_COUNT > 256"
+#endif
+#if (MSG_STDIN_BUFFER_BYTES < 1) || (MSG_STDIN_BUFFER_BYTES > INT_MAX)
+# error "MSG_STDIN_BUFFER_BYTES must be between 1 and INT_MAX"
+#endif
+#if MSG_USE_RING_LOG
+# if !MSG_USE_UNIX_IO
+#  error "MSG_USE_UNIX_IO must be set if MSG_USE_RING_LOG is set"
+# endif
+# if (MSG_RING_LOG_RECORD_BYTES < 16) || (MSG_RING_LOG_RECORD_BYTES > 0x10007U)
+#  error "MSG_RING_LOG_RECORD_BYTES must be between 16 and 65543"
+# endif
+# if (MSG_RING_LOG_RECORD_BYTES % 4U) != 0
+#  error "MSG_RING_LOG_RECORD_BYTES must be a multiple of 4"
+# endif
+# if !MSG_USE_INTERNAL_PRINTF && (MSG_RING_LOG_LINE_BYTES < 2)
+#  error "MSG_RING_LOG_LINE_BYTES < 2"
+# endif
+#endif
+#if MSG_RATE_LIMIT_SLOTS > 0
+# if (MSG_RATE_LIMIT_SLOTS & (MSG_RATE_LIMIT_SLOTS - 1U)) != 0
+#  error "MSG_RATE_LIMIT_SLOTS must be a power of 2"
+# endif
+# if !defined(MSG_RATE_LIMIT_GET_MS) && !MSG_USE_UNIX_IO
+#  error "MSG_RATE_LIMIT_GET_MS() must be defined if MSG_USE_UNIX_IO isn't set"
+# endif
 #endif
 
 #define CONFIG_FLAG_FORCED_SET(_f_) ((MSG_FORCED_CONFIG_FLAGS) & (_f_))
@@ -75,6 +129,15 @@ static char default_program_name[] = DEFAULT_PROGRAM_NAME;
 static char default_log_name[] = DEFAULT_LOG_NAME;
 #endif
 
+// Mirrors config.verbosity so the MSG_PRINT() macros can check it inline
+int_fast8_t _msg_verbosity = 0;
+#if MSG_USE_RING_LOG
+bool _msg_ring_log_open = false;
+#endif
+#if MSG_MODULE_COUNT > 0
+uint8_t _msg_module_verbosity[MSG_MODULE_COUNT];
+#endif
+
 static msg_config_t config = {
 #if MSG_USE_MALLOC
 	.error_prefix = default_error_prefix,
@@ -92,11 +155,20 @@ static msg_config_t config = {
 
 	.print_log_time = NULL,
 
+#if MSG_RATE_LIMIT_SLOTS > 0
+	.rate_limit_burst = 0,
+	.rate_limit_period_ms = 0,
+#endif
+
 #if MSG_USE_UNIX_IO
 	.stdin_fd = STDIN_FILENO,
 	.stdout_fd = STDOUT_FILENO,
 	.stderr_fd = STDERR_FILENO,
 	.log_fd = -1,
+	.log_max_bytes = 0,
+	.log_max_age_sec = 0,
+	.log_keep_count = 0,
+	.log_prealloc_bytes = 0,
 #else
 	.stdin_read = NULL,
 	.stdout_write = NULL,
@@ -106,6 +178,108 @@ static msg_config_t config = {
 };
 
 #if MSG_USE_UNIX_IO
+// State of the log file opened with msg_open_log(), used for rotation and
+// preallocation. The path is empty if the log fd wasn't opened by us.
+static struct {
+# if MSG_USE_MALLOC
+	char *path;
+# else
+	char path[MSG_LOG_PATH_BYTES];
+# endif
+	// The number of bytes in the log file.
+	off_t size;
+	// The offset up to which space has been reserved for the log file.
+	off_t prealloc_end;
+	// Set when the file system doesn't support preallocation.
+	bool prealloc_unsupported;
+	// The time at which the log file was opened.
+	time_t opened;
+} log_state;
+
+static void set_log_path(const char *path) {
+#if MSG_USE_MALLOC
+	if (log_state.path != NULL) {
+		free(log_state.path);
+	}
+	log_state.path = (path != NULL) ? strdup(path) : NULL;
+#else
+	// A truncated path would rotate the wrong file, so don't remember paths
+	// that don't fit.
+	if ((path == NULL) || (strlen(path) >= sizeof(log_state.path))) {
+		log_state.path[0] = 0;
+	} else {
+		strcpy(log_state.path, path);
+	}
+#endif
+
+	return;
+}
+INLINE bool log_path_is_set(void) {
+	return (POINTER_IS_VALID(log_state.path) && (log_state.path[0] != 0));
+}
+static void forget_log_state(void) {
+	set_log_path(NULL);
+	log_state.size = 0;
+	log_state.prealloc_end = 0;
+	log_state.prealloc_unsupported = false;
+
+	return;
+}
+
+INLINE ssize_t count_log_bytes(ssize_t n) {
+	if (n > 0) {
+		log_state.size += n;
+	}
+	return n;
+}
+
+# if MSG_USE_RING_LOG
+// The ring log file starts with a header padded to the size of one record,
+// followed by an array of fixed-size records. A record's sequence number is
+// cleared before its contents are changed and set again once it's complete,
+// so a reader can tell which records are usable even if the writer died
+// part-way through. Sequence numbers start at 1; 0 marks an empty record.
+// They wrap around after 2^32 records (skipping 0), so they're compared as
+// serial numbers; that works as long as there are fewer than 2^31 records.
+#  define RING_LOG_MAGIC "ulibring"
+#  define RING_LOG_TEXT_BYTES (MSG_RING_LOG_RECORD_BYTES - 8U)
+// The message is continued in the record with the next sequence number
+#  define RING_LOG_FLAG_MORE      0x01U
+// The record continues the message in the record with the previous sequence
+// number
+#  define RING_LOG_FLAG_CONTINUED 0x02U
+// The most records a ring log can hold
+#  define RING_LOG_MAX_RECORDS 0x7FFFFFFFU
+
+typedef struct {
+	char magic[8];
+	uint32_t record_bytes;
+	uint32_t record_count;
+} ring_log_header_t;
+
+typedef struct {
+	uint32_t seq;
+	uint16_t len;
+	uint8_t flags;
+	uint8_t reserved;
+	char text[RING_LOG_TEXT_BYTES];
+} ring_log_record_t;
+
+static struct {
+	// The mapped file, or NULL if no ring log is open.
+	uint8_t *map;
+	size_t map_size;
+	ring_log_record_t *records;
+	uint32_t count;
+	// The index of the next record to write.
+	uint32_t next;
+	// The last sequence number used.
+	uint32_t seq;
+	// The record currently being written.
+	ring_log_record_t *cur;
+} ring_log;
+# endif
+
 static ssize_t stdin_read(void *buf, size_t count) {
 	return (config.stdin_fd >= 0) ? read(config.stdin_fd, buf, count) : 0;
 }
@@ -134,45 +308,57 @@ static ssize_t stderr_write(const void *buf, size_t count) {
 }
 static ssize_t log_write(const void *buf, size_t count) {
 	if (WRITE_ALLOWED(log)) {
+#if MSG_USE_UNIX_IO
+		return count_log_bytes(WRITE(log, buf, count));
+#else
 		return WRITE(log, buf, count);
+#endif
 	}
 	return (ssize_t )count;
 }
 
 #if MSG_USE_INTERNAL_PRINTF
-static void stdout_putc(uint8_t c) {
-	WRITE(stdout, &c, 1);
+// Formatted output is passed along in spans rather than one character (and
+// one write) at a time.
+static void stdout_sink_write(void *ctx, const char *buf, size_t len) {
+	UNUSED(ctx);
+	stdout_write(buf, len);
 }
-static void stderr_putc(uint8_t c) {
-	WRITE(stderr, &c, 1);
+static void stderr_sink_write(void *ctx, const char *buf, size_t len) {
+	UNUSED(ctx);
+	stderr_write(buf, len);
 }
-static void log_putc(uint8_t c) {
-	WRITE(log, &c, 1);
+static void log_sink_write(void *ctx, const char *buf, size_t len) {
+	UNUSED(ctx);
+	log_write(buf, len);
 }
+static const printf_sink_t stdout_sink = { stdout_sink_write, NULL };
+static const printf_sink_t stderr_sink = { stderr_sink_write, NULL };
+static const printf_sink_t log_sink = { log_sink_write, NULL };
 
-static void _vprintf(bool OK, void (*pputc)(uint8_t c), const char *restrict format, va_list ap) {
+static void _vprintf(bool OK, const printf_sink_t *sink, const char *restrict format, va_list ap) {
 	if (OK) {
-		ulib_vprintf(pputc, format, ap);
+		ulib_vprintf_sink(sink, format, ap);
 	}
 	return;
 }
-# define stdout_vprintf(...) _vprintf(WRITE_ALLOWED(stdout), stdout_putc, __VA_ARGS__)
-# define stderr_vprintf(...) _vprintf(WRITE_ALLOWED(stderr), stderr_putc, __VA_ARGS__)
-# define log_vprintf(...) _vprintf(WRITE_ALLOWED(log), log_putc, __VA_ARGS__)
+# define stdout_vprintf(...) _vprintf(WRITE_ALLOWED(stdout), &stdout_sink, __VA_ARGS__)
+# define stderr_vprintf(...) _vprintf(WRITE_ALLOWED(stderr), &stderr_sink, __VA_ARGS__)
+# define log_vprintf(...) _vprintf(WRITE_ALLOWED(log), &log_sink, __VA_ARGS__)
 
-static void _printf(bool OK, void (*pputc)(uint8_t c), const char *restrict format, ...) {
+static void _printf(bool OK, const printf_sink_t *sink, const char *restrict format, ...) {
 	if (OK) {
 		va_list ap;
 
 		va_start(ap, format);
-		ulib_vprintf(pputc, format, ap);
+		ulib_vprintf_sink(sink, format, ap);
 		va_end(ap);
 	}
 	return;
 }
-# define stdout_printf(...) _printf(WRITE_ALLOWED(stdout), stdout_putc, __VA_ARGS__)
-# define stderr_printf(...) _printf(WRITE_ALLOWED(stderr), stderr_putc, __VA_ARGS__)
-# define log_printf(...) _printf(WRITE_ALLOWED(log), log_putc, __VA_ARGS__)
+# define stdout_printf(...) _printf(WRITE_ALLOWED(stdout), &stdout_sink, __VA_ARGS__)
+# define stderr_printf(...) _printf(WRITE_ALLOWED(stderr), &stderr_sink, __VA_ARGS__)
+# define log_printf(...) _printf(WRITE_ALLOWED(log), &log_sink, __VA_ARGS__)
 
 #else // ! MSG_USE_INTERNAL_PRINTF
 // This requires UNIX IO because there's no standard printf version that would
@@ -181,15 +367,15 @@ static void _printf(bool OK, void (*pputc)(uint8_t c), const char *restrict form
 #  error "MSG_USE_UNIX_IO must be set if MSG_USE_INTERNAL_PRINTF is not set"
 # endif
 
-static void _vprintf(int fd, const char *restrict format, va_list ap) {
+static int _vprintf(int fd, const char *restrict format, va_list ap) {
 	if (fd >= 0) {
-		vdprintf(fd, format, ap);
+		return vdprintf(fd, format, ap);
 	}
-	return;
+	return 0;
 }
 # define stdout_vprintf(...) _vprintf(config.stdout_fd, ## __VA_ARGS__)
 # define stderr_vprintf(...) _vprintf(config.stderr_fd, ## __VA_ARGS__)
-# define log_vprintf(...) _vprintf(config.log_fd, ## __VA_ARGS__)
+# define log_vprintf(...) count_log_bytes(_vprintf(config.log_fd, ## __VA_ARGS__))
 
 static void _printf(int fd, const char *restrict format, ...) {
 	if (fd >= 0) {
@@ -206,6 +392,177 @@ static void _printf(int fd, const char *restrict format, ...) {
 # define log_printf(...) _printf(config.log_fd, ## __VA_ARGS__)
 #endif // MSG_USE_INTERNAL_PRINTF
 
+#if MSG_RATE_LIMIT_SLOTS > 0
+// Rate-limiting is done with a generic cell rate algorithm: each call site
+// has a theoretical arrival time which is pushed forward by one emission
+// interval (period/burst) per printed message, and messages arriving more
+// than (period - interval) before it are dropped. This needs only one
+// timestamp per site and no division outside of the interval calculation.
+//
+// Call sites are stored in a table indexed by a hash of the format string
+// pointer, with up to RATE_LIMIT_PROBES slots checked for each one. When
+// they're all taken, the site that's been quiet the longest is evicted after
+// reporting anything it suppressed. If the evicted site is still being
+// limited, the new one inherits its schedule and suppressed count rather than
+// starting fresh, so several flooding sites that keep evicting each other are
+// limited together instead of not at all.
+#define RATE_LIMIT_ERROR 0U
+#define RATE_LIMIT_WARN  1U
+
+#if MSG_RATE_LIMIT_SLOTS < 4U
+# define RATE_LIMIT_PROBES MSG_RATE_LIMIT_SLOTS
+#else
+# define RATE_LIMIT_PROBES 4U
+#endif
+
+typedef struct {
+	const char *fmt;
+	uint32_t tat_ms;
+	uint32_t suppressed;
+	uint_fast8_t kind;
+	// Set when suppressed includes messages from more than one call site.
+	bool shared;
+} rate_limit_slot_t;
+
+static rate_limit_slot_t rate_limit_slots[MSG_RATE_LIMIT_SLOTS];
+
+# ifndef MSG_RATE_LIMIT_GET_MS
+#  define MSG_RATE_LIMIT_GET_MS() (get_monotonic_ms())
+#  if defined(CLOCK_MONOTONIC_COARSE)
+#   define RATE_LIMIT_CLOCK CLOCK_MONOTONIC_COARSE
+#  else
+#   define RATE_LIMIT_CLOCK CLOCK_MONOTONIC
+#  endif
+static uint32_t get_monotonic_ms(void) {
+	struct timespec now;
+
+	if (clock_gettime(RATE_LIMIT_CLOCK, &now) == -1) {
+		return 0;
+	}
+	return (uint32_t )(((uint64_t )now.tv_sec * 1000U) + ((uint64_t )now.tv_nsec / 1000000U));
+}
+# endif
+
+static void print_suppressed(const rate_limit_slot_t *slot, bool evicted) {
+	const char *prefix = (slot->kind == RATE_LIMIT_WARN) ? config.warn_prefix : config.error_prefix;
+
+	if (config.program_name[0] != 0) {
+		stderr_printf("%s: ", config.program_name);
+	}
+	if (prefix[0] != 0) {
+		stderr_printf("%s", prefix);
+	}
+	if (slot->shared) {
+		stderr_printf("%u messages suppressed", (uint_t )slot->suppressed);
+	} else if (evicted) {
+		stderr_printf("%u messages like \"%s\" suppressed", (uint_t )slot->suppressed, slot->fmt);
+	} else {
+		stderr_printf("%u similar messages suppressed", (uint_t )slot->suppressed);
+	}
+	stderr_write(newline, newline_len);
+
+	return;
+}
+// Find the slot used for fmt, or the one it should replace.
+static rate_limit_slot_t* find_rate_limit_slot(const char *fmt, uint32_t now) {
+	rate_limit_slot_t *victim = NULL;
+	uint32_t hash;
+
+	// Format strings have no particular alignment, so mix the high bits into
+	// the low ones rather than just dropping a few.
+	hash = (uint32_t )((uintptr_t )fmt) * 0x9E3779B1U;
+	hash ^= hash >> 16U;
+
+	for (uint_fast8_t i = 0; i < RATE_LIMIT_PROBES; ++i) {
+		rate_limit_slot_t *slot = &rate_limit_slots[(hash + i) & (MSG_RATE_LIMIT_SLOTS - 1U)];
+
+		if ((slot->fmt == fmt) || (slot->fmt == NULL)) {
+			return slot;
+		}
+		// The slot whose next message is due earliest is the least busy.
+		if ((victim == NULL) || ((int32_t )(slot->tat_ms - now) < (int32_t )(victim->tat_ms - now))) {
+			victim = slot;
+		}
+	}
+
+	return victim;
+}
+static bool rate_limit_allows(const char *fmt, uint_fast8_t kind) {
+	rate_limit_slot_t *slot;
+	uint32_t now, interval, tolerance;
+
+	if (!CONFIG_FLAG_IS_SET(MSG_FLAG_RATE_LIMIT) || (config.rate_limit_burst == 0) || (config.rate_limit_period_ms == 0)) {
+		return true;
+	}
+
+	now = (uint32_t )MSG_RATE_LIMIT_GET_MS();
+	slot = find_rate_limit_slot(fmt, now);
+	interval = (uint32_t )(config.rate_limit_period_ms / config.rate_limit_burst);
+	if (interval == 0) {
+		interval = 1;
+	}
+	tolerance = (uint32_t )config.rate_limit_period_ms - interval;
+
+	if (slot->fmt == NULL) {
+		slot->tat_ms = now;
+	} else if (slot->fmt != fmt) {
+		// Keep tat_ms; see the note above.
+		uint32_t ahead = slot->tat_ms - now;
+
+		if ((ahead > tolerance) && (ahead <= (UINT32_MAX / 2U))) {
+			if (slot->suppressed > 0) {
+				slot->shared = true;
+			}
+		} else {
+			if (slot->suppressed > 0) {
+				print_suppressed(slot, true);
+			}
+			slot->suppressed = 0;
+			slot->shared = false;
+		}
+	}
+	slot->fmt = fmt;
+	slot->kind = kind;
+
+	// The timestamps may wrap around, so anything more than halfway around is
+	// in the past.
+	if ((slot->tat_ms - now) > (UINT32_MAX / 2U)) {
+		slot->tat_ms = now;
+	}
+	if ((slot->tat_ms - now) > tolerance) {
+		if (slot->suppressed != UINT32_MAX) {
+			++slot->suppressed;
+		}
+		return false;
+	}
+	slot->tat_ms += interval;
+
+	if (slot->suppressed > 0) {
+		print_suppressed(slot, false);
+		slot->suppressed = 0;
+		slot->shared = false;
+	}
+
+	return true;
+}
+void msg_flush_suppressed(void) {
+	for (uint_fast16_t i = 0; i < MSG_RATE_LIMIT_SLOTS; ++i) {
+		rate_limit_slot_t *slot = &rate_limit_slots[i];
+
+		if ((slot->fmt != NULL) && (slot->suppressed > 0)) {
+			print_suppressed(slot, true);
+			slot->suppressed = 0;
+			slot->shared = false;
+		}
+	}
+
+	return;
+}
+# define RATE_LIMIT_ALLOWS(_fmt_, _kind_) (rate_limit_allows((_fmt_), (_kind_)))
+#else
+# define RATE_LIMIT_ALLOWS(_fmt_, _kind_) (true)
+#endif // MSG_RATE_LIMIT_SLOTS > 0
+
 int msg_puts(const char *s) {
 	size_t len;
 	ssize_t writ = 0;
@@ -230,9 +587,59 @@ int msg_puts(const char *s) {
 
 	return 0;
 }
+// Input is read from stdin in blocks and handed out from this buffer. The
+// buffer is only refilled once it's been used up, so when reading from a
+// terminal (where read() returns at the end of each line) we never wait for
+// anything beyond the current line.
+static struct {
+	char buf[MSG_STDIN_BUFFER_BYTES];
+	// The next unread byte.
+	size_t start;
+	// One past the last buffered byte.
+	size_t end;
+} stdin_buf;
+
+static void reset_stdin_buf(void) {
+	stdin_buf.start = 0;
+	stdin_buf.end = 0;
+
+	return;
+}
+// Read more input into the end of the buffer.
+// Returns the number of bytes read, 0 on EOF, or -errno on error.
+static int refill_stdin_buf(void) {
+	ssize_t r;
+
+	do {
+		r = stdin_read(&stdin_buf.buf[stdin_buf.end], sizeof(stdin_buf.buf) - stdin_buf.end);
+	} while ((r == -1) && (errno == EINTR));
+
+	if (r < 0) {
+		return -errno;
+	}
+	stdin_buf.end += (size_t )r;
+
+	return (int )r;
+}
+// Returns 1 if a byte was read, 0 on EOF, or -errno on error.
+static int stdin_getc(char *c) {
+	if (stdin_buf.start == stdin_buf.end) {
+		int r;
+
+		reset_stdin_buf();
+		if ((r = refill_stdin_buf()) <= 0) {
+			return r;
+		}
+	}
+	*c = stdin_buf.buf[stdin_buf.start];
+	++stdin_buf.start;
+
+	return 1;
+}
+
 int msg_gets(char *restrict s, int size) {
 	char b;
-	ssize_t r;
+	int r;
 	int have;
 
 	ulib_assert(s != NULL);
@@ -248,11 +655,9 @@ int msg_gets(char *restrict s, int size) {
 
 	size -= 1;
 	for (have = 0; have < size;) {
-		r = stdin_read(&b, 1);
-		if (r == -1) {
-			if (errno != EINTR) {
-				return -errno;
-			}
+		r = stdin_getc(&b);
+		if (r < 0) {
+			return r;
 		} else if ((r == 0) || (b == '\n') || (b == 0)) {
 			break;
 		} else if (b == '\r') {
@@ -270,6 +675,74 @@ int msg_gets(char *restrict s, int size) {
 
 	return have;
 }
+int msg_getline(const char **line) {
+	size_t r, w;
+
+	ulib_assert(line != NULL);
+#if DO_MSG_SAFETY_CHECKS
+	if (line == NULL) {
+		return -EINVAL;
+	}
+#endif
+
+	*line = NULL;
+	// The line is edited in place: 'r' is the next byte to look at and 'w'
+	// is where it goes once carriage returns and backspaces are handled.
+	r = w = stdin_buf.start;
+	while (true) {
+		int ret;
+
+		for (; r < stdin_buf.end; ++r) {
+			char b = stdin_buf.buf[r];
+
+			if ((b == '\n') || (b == 0)) {
+				*line = &stdin_buf.buf[stdin_buf.start];
+				ret = (int )(w - stdin_buf.start);
+				stdin_buf.start = r + 1U;
+				return ret;
+			} else if (b == '\r') {
+				// Nothing to  do here.
+			} else if (b == '\b') {
+				if (w > stdin_buf.start) {
+					--w;
+				}
+			} else {
+				stdin_buf.buf[w] = b;
+				++w;
+			}
+		}
+
+		// Move what we have of the line to the start of the buffer to make
+		// room for more. Since it's already been edited, doing it again after
+		// an error is harmless.
+		w -= stdin_buf.start;
+		if (stdin_buf.start > 0) {
+			memmove(stdin_buf.buf, &stdin_buf.buf[stdin_buf.start], w);
+		}
+		stdin_buf.start = 0;
+		stdin_buf.end = w;
+		r = w;
+
+		if (w < sizeof(stdin_buf.buf)) {
+			ret = refill_stdin_buf();
+			if (ret < 0) {
+				return ret;
+			}
+			if (ret > 0) {
+				continue;
+			}
+			if (w == 0) {
+				// EOF with nothing left
+				return 0;
+			}
+		}
+		// Either the line doesn't fit in the buffer or there's no newline
+		// before EOF; return what we have.
+		*line = stdin_buf.buf;
+		stdin_buf.start = w;
+		return (int )w;
+	}
+}
 
 #if MSG_USE_MALLOC
 static char* set_config_string(char *now, const char *new, const char *def) {
@@ -324,6 +797,12 @@ static int set_config_fd(int old_fd, int new_fd) {
 }
 #endif
 
+static void set_verbosity(int_fast8_t verbosity) {
+	config.verbosity = verbosity;
+	_msg_verbosity = verbosity;
+
+	return;
+}
 int msg_config(msg_config_t *new_config) {
 	ulib_assert(new_config != NULL);
 
@@ -333,8 +812,12 @@ int msg_config(msg_config_t *new_config) {
 	}
 #endif
 
-	config.verbosity = new_config->verbosity;
+	set_verbosity(new_config->verbosity);
 	config.flags = new_config->flags;
+#if MSG_RATE_LIMIT_SLOTS > 0
+	config.rate_limit_burst = new_config->rate_limit_burst;
+	config.rate_limit_period_ms = new_config->rate_limit_period_ms;
+#endif
 
 	// FIXME: Can't disable once set.
 	if (new_config->print_log_time != NULL) {
@@ -342,14 +825,27 @@ int msg_config(msg_config_t *new_config) {
 	}
 
 #if MSG_USE_UNIX_IO
+	if ((new_config->stdin_fd != -1) && (new_config->stdin_fd != config.stdin_fd)) {
+		// Anything buffered belongs to the old input.
+		reset_stdin_buf();
+	}
 	config.stdin_fd = set_config_fd(config.stdin_fd, new_config->stdin_fd);
 	config.stdout_fd = set_config_fd(config.stdout_fd, new_config->stdout_fd);
 	config.stderr_fd = set_config_fd(config.stderr_fd, new_config->stderr_fd);
+	if ((new_config->log_fd != -1) && (new_config->log_fd != config.log_fd)) {
+		// We don't know where this came from, so it can't be rotated.
+		forget_log_state();
+	}
 	config.log_fd = set_config_fd(config.log_fd, new_config->log_fd);
+	config.log_max_bytes = new_config->log_max_bytes;
+	config.log_max_age_sec = new_config->log_max_age_sec;
+	config.log_keep_count = new_config->log_keep_count;
+	config.log_prealloc_bytes = new_config->log_prealloc_bytes;
 
 #else // MSG_USE_UNIX_IO
 	// FIXME: Can't disable once a value has been set.
-	if (new_config->stdin_read != NULL) {
+	if ((new_config->stdin_read != NULL) && (new_config->stdin_read != config.stdin_read)) {
+		reset_stdin_buf();
 		config.stdin_read = new_config->stdin_read;
 	}
 	if (new_config->stdout_write != NULL) {
@@ -388,10 +884,27 @@ uint_fast8_t msg_set_flags(uint_fast8_t flags) {
 }
 int_fast8_t msg_set_verbosity(int_fast8_t verbosity) {
 	int_fast8_t old = config.verbosity;
-	config.verbosity = verbosity;
+	set_verbosity(verbosity);
 
 	return old;
 }
+#if MSG_MODULE_COUNT > 0
+int_fast8_t msg_set_module_verbosity(uint_fast8_t module, int_fast8_t verbosity) {
+	int_fast8_t old;
+
+	ulib_assert(module < MSG_MODULE_COUNT);
+# if DO_MSG_SAFETY_CHECKS
+	if (module >= MSG_MODULE_COUNT) {
+		return MSG_VERB_INHERIT;
+	}
+# endif
+
+	old = (int_fast8_t )((int_fast16_t )_msg_module_verbosity[module] + MSG_VERB_INHERIT);
+	_msg_module_verbosity[module] = (uint8_t )(verbosity - MSG_VERB_INHERIT);
+
+	return old;
+}
+#endif
 
 int msg_get_config(msg_config_t *cfg) {
 #if DO_MSG_SAFETY_CHECKS
@@ -405,16 +918,495 @@ int msg_get_config(msg_config_t *cfg) {
 }
 
 #if MSG_USE_UNIX_IO
-int msg_open_log(const char* path) {
-	int o_flags = O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC;
-	int new_fd;
+// The cached log time is stored with the surrounding brackets in the format
+// '[YYYY.MM.DD_HH:mm:ss.fff] ' so that msg_log() can write the whole prefix
+// at once. The offsets are those of the first character of each field.
+#define LOG_TIME_YEAR_OFF   1U
+#define LOG_TIME_MONTH_OFF  6U
+#define LOG_TIME_DAY_OFF    9U
+#define LOG_TIME_HOUR_OFF   12U
+#define LOG_TIME_MINUTE_OFF 15U
+#define LOG_TIME_SECOND_OFF 18U
+#define LOG_TIME_SUBSEC_OFF 21U
+#if MSG_LOG_TIME_SUBSEC_DIGITS > 0
+# define LOG_TIME_END_OFF (LOG_TIME_SUBSEC_OFF + MSG_LOG_TIME_SUBSEC_DIGITS)
+#else
+# define LOG_TIME_END_OFF (LOG_TIME_SECOND_OFF + 2U)
+#endif
+// The length of the prefix, excluding the trailing NUL.
+#define LOG_TIME_PREFIX_LEN (LOG_TIME_END_OFF + 2U)
+
+static struct {
+	// The epoch second currently rendered in the buffer.
+	time_t second;
+	// The epoch second at the start of the rendered minute; as long as the
+	// time stays within the same minute only the seconds field needs to be
+	// updated.
+	time_t minute;
+	char prefix[LOG_TIME_PREFIX_LEN + 1];
+} log_time_cache = {
+	.second = -1,
+	.minute = -1,
+};
+
+static void print_2_digits(char *buf, uint_fast8_t n) {
+	buf[0] = (char )('0' + (n / 10U));
+	buf[1] = (char )('0' + (n % 10U));
+	return;
+}
+static void update_log_time_cache(void) {
+	struct timespec now;
+	char *buf = log_time_cache.prefix;
 
+	if (clock_gettime(LOG_TIME_CLOCK, &now) == -1) {
+		now.tv_sec = time(NULL);
+		now.tv_nsec = 0;
+	}
+
+	if (now.tv_sec != log_time_cache.second) {
+		time_t offset = now.tv_sec - log_time_cache.minute;
+
+		if ((log_time_cache.minute >= 0) && (offset >= 0) && (offset < 60)) {
+			print_2_digits(&buf[LOG_TIME_SECOND_OFF], (uint_fast8_t )offset);
+		} else {
+			struct tm tm;
+			uint_fast16_t year;
+
+#if MSG_LOG_TIME_USE_UTC
+			if (gmtime_r(&now.tv_sec, &tm) == NULL) {
+#else
+			if (localtime_r(&now.tv_sec, &tm) == NULL) {
+#endif
+				return;
+			}
+			year = (uint_fast16_t )((tm.tm_year + 1900) % 10000);
+
+			buf[0] = '[';
+			print_2_digits(&buf[LOG_TIME_YEAR_OFF], (uint_fast8_t )(year / 100U));
+			print_2_digits(&buf[LOG_TIME_YEAR_OFF+2U], (uint_fast8_t )(year % 100U));
+			buf[LOG_TIME_MONTH_OFF-1U] = '.';
+			print_2_digits(&buf[LOG_TIME_MONTH_OFF], (uint_fast8_t )(tm.tm_mon + 1));
+			buf[LOG_TIME_DAY_OFF-1U] = '.';
+			print_2_digits(&buf[LOG_TIME_DAY_OFF], (uint_fast8_t )tm.tm_mday);
+			buf[LOG_TIME_HOUR_OFF-1U] = '_';
+			print_2_digits(&buf[LOG_TIME_HOUR_OFF], (uint_fast8_t )tm.tm_hour);
+			buf[LOG_TIME_MINUTE_OFF-1U] = ':';
+			print_2_digits(&buf[LOG_TIME_MINUTE_OFF], (uint_fast8_t )tm.tm_min);
+			buf[LOG_TIME_SECOND_OFF-1U] = ':';
+			print_2_digits(&buf[LOG_TIME_SECOND_OFF], (uint_fast8_t )tm.tm_sec);
+#if MSG_LOG_TIME_SUBSEC_DIGITS > 0
+			buf[LOG_TIME_SUBSEC_OFF-1U] = '.';
+#endif
+			buf[LOG_TIME_END_OFF] = ']';
+			buf[LOG_TIME_END_OFF+1U] = ' ';
+			buf[LOG_TIME_END_OFF+2U] = 0;
+
+			// A leap second doesn't belong to a regular minute, so don't cache it.
+			log_time_cache.minute = (tm.tm_sec < 60) ? now.tv_sec - tm.tm_sec : -1;
+		}
+		log_time_cache.second = now.tv_sec;
+	}
+
+#if MSG_LOG_TIME_SUBSEC_DIGITS > 0
+	{
+		uint_fast32_t subsec = (uint_fast32_t )now.tv_nsec;
+
+		for (uint_fast8_t i = 9; i > MSG_LOG_TIME_SUBSEC_DIGITS; --i) {
+			subsec /= 10U;
+		}
+		for (uint_fast8_t i = LOG_TIME_END_OFF; i > LOG_TIME_SUBSEC_OFF; --i) {
+			buf[i-1U] = (char )('0' + (subsec % 10U));
+			subsec /= 10U;
+		}
+	}
+#endif
+
+	return;
+}
+const char* msg_print_log_time_cached(char *buf, size_t size) {
+	size_t len;
+
+	ulib_assert(buf != NULL);
+	ulib_assert(size > 0);
 #if DO_MSG_SAFETY_CHECKS
-	if (path == NULL || path[0] == 0) {
-		return -EINVAL;
+	if ((buf == NULL) || (size == 0)) {
+		return "";
 	}
 #endif
 
+	update_log_time_cache();
+	if (log_time_cache.second < 0) {
+		buf[0] = 0;
+		return buf;
+	}
+
+	len = MIN(size-1U, LOG_TIME_END_OFF - 1U);
+	memcpy(buf, &log_time_cache.prefix[1], len);
+	buf[len] = 0;
+
+	return buf;
+}
+
+#if MSG_USE_RING_LOG
+static uint32_t next_seq(uint32_t seq) {
+	++seq;
+	return (seq == 0) ? 1U : seq;
+}
+// Check whether sequence number a came after b, allowing for wrap-around.
+static bool seq_is_newer(uint32_t a, uint32_t b) {
+	return ((int32_t )(a - b) > 0);
+}
+static void ring_log_start_record(uint8_t flags) {
+	ring_log_record_t *r = &ring_log.records[ring_log.next];
+
+	ring_log.seq = next_seq(ring_log.seq);
+	++ring_log.next;
+	if (ring_log.next == ring_log.count) {
+		ring_log.next = 0;
+	}
+
+	__atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	r->len = 0;
+	r->flags = flags;
+	ring_log.cur = r;
+
+	return;
+}
+static void ring_log_end_record(uint8_t flags) {
+	ring_log.cur->flags |= flags;
+	__atomic_store_n(&ring_log.cur->seq, ring_log.seq, __ATOMIC_RELEASE);
+
+	return;
+}
+static void ring_log_write(const char *buf, size_t len) {
+	while (len > 0) {
+		ring_log_record_t *r = ring_log.cur;
+		size_t n;
+
+		if (r->len == RING_LOG_TEXT_BYTES) {
+			ring_log_end_record(RING_LOG_FLAG_MORE);
+			ring_log_start_record(RING_LOG_FLAG_CONTINUED);
+			r = ring_log.cur;
+		}
+		n = RING_LOG_TEXT_BYTES - r->len;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(&r->text[r->len], buf, n);
+		r->len = (uint16_t )(r->len + n);
+		buf += n;
+		len -= n;
+	}
+
+	return;
+}
+# if MSG_USE_INTERNAL_PRINTF
+static void ring_log_sink_write(void *ctx, const char *buf, size_t len) {
+	UNUSED(ctx);
+	ring_log_write(buf, len);
+}
+static const printf_sink_t ring_log_sink = { ring_log_sink_write, NULL };
+# endif
+static void ring_log_message(const char *prefix, const char *suffix, const char *restrict fmt, va_list args) {
+	ring_log_start_record(0);
+	if ((prefix != NULL) && (prefix[0] != 0)) {
+		ring_log_write(prefix, strlen(prefix));
+	}
+# if MSG_USE_INTERNAL_PRINTF
+	ulib_vprintf_sink(&ring_log_sink, fmt, args);
+# else
+	{
+		char line[MSG_RING_LOG_LINE_BYTES];
+		int n = vsnprintf(line, sizeof(line), fmt, args);
+
+		if (n > 0) {
+			ring_log_write(line, ((size_t )n < sizeof(line)) ? (size_t )n : sizeof(line) - 1U);
+		}
+	}
+# endif
+	if (suffix != NULL) {
+		ring_log_write(": ", 2);
+		ring_log_write(suffix, strlen(suffix));
+	}
+	ring_log_end_record(0);
+
+	return;
+}
+# define RING_LOG_MESSAGE(_prefix_, _suffix_, _fmt_) \
+	do { \
+		if (ring_log.map != NULL) { \
+			va_list _ring_args_; \
+			va_start(_ring_args_, _fmt_); \
+			ring_log_message((_prefix_), (_suffix_), (_fmt_), _ring_args_); \
+			va_end(_ring_args_); \
+		} \
+	} while (0)
+# define RING_LOG_VMESSAGE(_prefix_, _suffix_, _fmt_, _args_) \
+	do { \
+		if (ring_log.map != NULL) { \
+			va_list _ring_args_; \
+			va_copy(_ring_args_, _args_); \
+			ring_log_message((_prefix_), (_suffix_), (_fmt_), _ring_args_); \
+			va_end(_ring_args_); \
+		} \
+	} while (0)
+
+static bool ring_log_header_is_valid(const uint8_t *map, size_t size) {
+	const ring_log_header_t *h = (const ring_log_header_t *)map;
+
+	return (
+		(size >= (2U * MSG_RING_LOG_RECORD_BYTES)) &&
+		(memcmp(h->magic, RING_LOG_MAGIC, sizeof(h->magic)) == 0) &&
+		(h->record_bytes == MSG_RING_LOG_RECORD_BYTES) &&
+		(h->record_count > 0) &&
+		(h->record_count <= RING_LOG_MAX_RECORDS) &&
+		(h->record_count <= ((size / MSG_RING_LOG_RECORD_BYTES) - 1U))
+	);
+}
+// Returns the index of the record with the newest sequence number, or
+// 'count' if all records are empty.
+static uint32_t find_newest_record(const ring_log_record_t *records, uint32_t count) {
+	uint32_t newest = count, max_seq = 0;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t seq = __atomic_load_n(&records[i].seq, __ATOMIC_ACQUIRE);
+
+		if ((seq != 0) && ((newest == count) || seq_is_newer(seq, max_seq))) {
+			max_seq = seq;
+			newest = i;
+		}
+	}
+
+	return newest;
+}
+static void* map_ring_log(const char *path, bool writeable, size_t *size) {
+	struct stat st;
+	void *map;
+	int fd, err;
+
+	fd = open(path, (writeable) ? (O_RDWR|O_CREAT|O_CLOEXEC) : (O_RDONLY|O_CLOEXEC), 0644);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (writeable) {
+		if ((fstat(fd, &st) == -1) || ((st.st_size != (off_t )*size) && (ftruncate(fd, (off_t )*size) == -1))) {
+			goto ERR;
+		}
+	} else {
+		if (fstat(fd, &st) == -1) {
+			goto ERR;
+		}
+		if ((st.st_size < 0) || ((uintmax_t )st.st_size > SIZE_MAX)) {
+			errno = EFBIG;
+			goto ERR;
+		}
+		*size = (size_t )st.st_size;
+		if (*size < (2U * MSG_RING_LOG_RECORD_BYTES)) {
+			errno = EINVAL;
+			goto ERR;
+		}
+	}
+
+	map = mmap(NULL, *size, (writeable) ? (PROT_READ|PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		goto ERR;
+	}
+	close(fd);
+
+	return map;
+
+ERR:
+	err = errno;
+	close(fd);
+	errno = err;
+	return NULL;
+}
+
+int msg_open_ring_log(const char *path, size_t size) {
+	uint8_t *map;
+	size_t count;
+
+	ulib_assert(path != NULL);
+	ulib_assert(size >= (2U * MSG_RING_LOG_RECORD_BYTES));
+# if DO_MSG_SAFETY_CHECKS
+	if ((path == NULL) || (path[0] == 0)) {
+		return -EINVAL;
+	}
+	if (size < (2U * MSG_RING_LOG_RECORD_BYTES)) {
+		return -EINVAL;
+	}
+# endif
+
+	count = (size / MSG_RING_LOG_RECORD_BYTES) - 1U;
+	if (count > RING_LOG_MAX_RECORDS) {
+		count = RING_LOG_MAX_RECORDS;
+	}
+	size = (count + 1U) * MSG_RING_LOG_RECORD_BYTES;
+
+	map = map_ring_log(path, true, &size);
+	if (map == NULL) {
+		return -errno;
+	}
+
+	msg_close_ring_log();
+
+	ring_log.map = map;
+	ring_log.map_size = size;
+	ring_log.records = (ring_log_record_t *)(map + MSG_RING_LOG_RECORD_BYTES);
+	ring_log.count = (uint32_t )count;
+	ring_log.next = 0;
+	ring_log.seq = 0;
+
+	if (ring_log_header_is_valid(map, size) && (((const ring_log_header_t *)map)->record_count == count)) {
+		uint32_t newest = find_newest_record(ring_log.records, ring_log.count);
+
+		if (newest < ring_log.count) {
+			ring_log.seq = ring_log.records[newest].seq;
+			ring_log.next = (newest + 1U < ring_log.count) ? newest + 1U : 0;
+		}
+	} else {
+		ring_log_header_t *h = (ring_log_header_t *)map;
+
+		memset(map, 0, size);
+		memcpy(h->magic, RING_LOG_MAGIC, sizeof(h->magic));
+		h->record_bytes = MSG_RING_LOG_RECORD_BYTES;
+		h->record_count = (uint32_t )count;
+	}
+
+	_msg_ring_log_open = true;
+
+	return 0;
+}
+int msg_close_ring_log(void) {
+	if (ring_log.map != NULL) {
+		munmap(ring_log.map, ring_log.map_size);
+		ring_log.map = NULL;
+		ring_log.records = NULL;
+		ring_log.cur = NULL;
+		_msg_ring_log_open = false;
+	}
+
+	return 0;
+}
+// Write all of buf to fd.
+// Returns 0 on success or a negative errno on failure.
+static int dump_write(int fd, const char *buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -errno;
+		}
+		buf += n;
+		len -= (size_t )n;
+	}
+
+	return 0;
+}
+int msg_dump_ring_log(const char *path, int fd) {
+	const ring_log_record_t *records;
+	uint8_t *map;
+	size_t size;
+	uint32_t count, newest, prev_seq = 0;
+	uint_fast8_t prev_flags = 0;
+	int msgs = 0, err = 0;
+
+	ulib_assert(path != NULL);
+	ulib_assert(fd >= 0);
+# if DO_MSG_SAFETY_CHECKS
+	if ((path == NULL) || (path[0] == 0)) {
+		return -EINVAL;
+	}
+	if (fd < 0) {
+		return -EINVAL;
+	}
+# endif
+
+	map = map_ring_log(path, false, &size);
+	if (map == NULL) {
+		return -errno;
+	}
+	if (!ring_log_header_is_valid(map, size)) {
+		munmap(map, size);
+		return -EINVAL;
+	}
+	count = ((const ring_log_header_t *)map)->record_count;
+	records = (const ring_log_record_t *)(map + MSG_RING_LOG_RECORD_BYTES);
+
+	newest = find_newest_record(records, count);
+	for (uint32_t n = 0, i = newest + 1U; (newest < count) && (n < count); ++n, ++i) {
+		char text[RING_LOG_TEXT_BYTES];
+		uint32_t seq;
+		uint_fast16_t len;
+		uint_fast8_t flags;
+
+		if (i >= count) {
+			i = 0;
+		}
+		// Copy the record out and make sure it didn't change while we were
+		// reading it in case the writer is still running.
+		seq = __atomic_load_n(&records[i].seq, __ATOMIC_ACQUIRE);
+		if (seq == 0) {
+			continue;
+		}
+		len = records[i].len;
+		flags = records[i].flags;
+		if (len > RING_LOG_TEXT_BYTES) {
+			continue;
+		}
+		memcpy(text, records[i].text, len);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&records[i].seq, __ATOMIC_RELAXED) != seq) {
+			continue;
+		}
+
+		if (BIT_IS_SET(flags, RING_LOG_FLAG_CONTINUED)) {
+			// Skip the tail of a message whose start has been overwritten.
+			if ((seq != next_seq(prev_seq)) || !BIT_IS_SET(prev_flags, RING_LOG_FLAG_MORE)) {
+				continue;
+			}
+		} else {
+			if (BIT_IS_SET(prev_flags, RING_LOG_FLAG_MORE)) {
+				// The rest of the previous message was lost.
+				if ((err = dump_write(fd, newline, newline_len)) != 0) {
+					break;
+				}
+			}
+			if (dprintf(fd, "%lu ", (unsigned long )seq) < 0) {
+				err = (errno != 0) ? -errno : -EIO;
+				break;
+			}
+			++msgs;
+		}
+		if ((err = dump_write(fd, text, len)) != 0) {
+			break;
+		}
+		if (!BIT_IS_SET(flags, RING_LOG_FLAG_MORE)) {
+			if ((err = dump_write(fd, newline, newline_len)) != 0) {
+				break;
+			}
+		}
+		prev_seq = seq;
+		prev_flags = flags;
+	}
+	if ((err == 0) && BIT_IS_SET(prev_flags, RING_LOG_FLAG_MORE)) {
+		err = dump_write(fd, newline, newline_len);
+	}
+
+	munmap(map, size);
+
+	return (err != 0) ? err : msgs;
+}
+#endif // MSG_USE_RING_LOG
+
+static int open_log_fd(const char *path) {
+	int o_flags = O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC;
+	int new_fd;
+
 	if (CONFIG_FLAG_IS_SET(MSG_FLAG_LOG_DIRECT)) {
 		SET_BIT(o_flags, O_DIRECT);
 	}
@@ -429,6 +1421,13 @@ int msg_open_log(const char* path) {
 		msg_liberrno(errno, "%s: failed to open log file", path);
 		return ret;
 	}
+
+	return new_fd;
+}
+// Replace the current log fd with new_fd.
+static void swap_log_fd(int new_fd) {
+	struct stat st;
+
 	if (is_closeable_fd(config.log_fd)) {
 		if (close(config.log_fd) == -1) {
 			msg_liberrno(errno, "%s: close() error", config.log_name);
@@ -436,6 +1435,120 @@ int msg_open_log(const char* path) {
 	}
 	config.log_fd = new_fd;
 
+	log_state.size = (fstat(new_fd, &st) == 0) ? st.st_size : 0;
+	log_state.prealloc_end = log_state.size;
+	log_state.opened = time(NULL);
+
+	return;
+}
+
+// Print '<path>.<gen>' to buf, which must be at least strlen(path)+5 bytes.
+static void print_log_generation(char *buf, const char *path, size_t path_len, uint_fast8_t gen) {
+	memcpy(buf, path, path_len);
+	if (gen == 0) {
+		buf[path_len] = 0;
+	} else {
+		buf[path_len] = '.';
+		cstring_from_uint(&buf[path_len+1U], 4, gen, 10);
+	}
+
+	return;
+}
+static void rotate_log(void) {
+	const char *path = log_state.path;
+	size_t path_len = strlen(path);
+	int new_fd;
+#if MSG_USE_MALLOC
+	char *from = malloc(path_len + 5U);
+	char *to = malloc(path_len + 5U);
+
+	if ((from == NULL) || (to == NULL)) {
+		free(from);
+		free(to);
+		return;
+	}
+#else
+	char from[MSG_LOG_PATH_BYTES + 4U];
+	char to[MSG_LOG_PATH_BYTES + 4U];
+#endif
+
+	if (config.log_keep_count == 0) {
+		if ((unlink(path) == -1) && (errno != ENOENT)) {
+			msg_liberrno(errno, "%s: failed to remove log file", path);
+		}
+	} else {
+		// rename() replaces the destination atomically, so each file is always
+		// available under one name or the other.
+		for (uint_fast8_t gen = config.log_keep_count; gen > 0; --gen) {
+			print_log_generation(from, path, path_len, (uint_fast8_t )(gen-1U));
+			print_log_generation(to, path, path_len, gen);
+			if ((rename(from, to) == -1) && (errno != ENOENT)) {
+				msg_liberrno(errno, "%s: failed to rotate log file", from);
+			}
+		}
+	}
+
+#if MSG_USE_MALLOC
+	free(from);
+	free(to);
+#endif
+
+	if ((new_fd = open_log_fd(path)) < 0) {
+		// Keep writing to the old file, but don't try again until the next
+		// period is up. The old fd now refers to the rotated file, so its
+		// reservation no longer matches the count.
+		log_state.size = 0;
+		log_state.prealloc_end = 0;
+		log_state.opened = time(NULL);
+		return;
+	}
+	swap_log_fd(new_fd);
+
+	return;
+}
+// Called between messages to handle rotation and preallocation of the log.
+static void maintain_log(void) {
+	if (!log_path_is_set()) {
+		return;
+	}
+
+	if (
+		((config.log_max_bytes > 0) && (log_state.size >= config.log_max_bytes)) ||
+		((config.log_max_age_sec > 0) && ((time(NULL) - log_state.opened) >= config.log_max_age_sec))
+	) {
+		rotate_log();
+	}
+
+#if defined(FALLOC_FL_KEEP_SIZE)
+	if ((config.log_prealloc_bytes > 0) && !log_state.prealloc_unsupported && (log_state.size >= log_state.prealloc_end)) {
+		// The reserved space isn't counted in the file size, so appending still
+		// works as expected. If it fails for any other reason, don't try again
+		// until another block's worth has been written.
+		if ((fallocate(config.log_fd, FALLOC_FL_KEEP_SIZE, log_state.size, config.log_prealloc_bytes) == -1) && (errno == EOPNOTSUPP)) {
+			log_state.prealloc_unsupported = true;
+		}
+		log_state.prealloc_end = log_state.size + config.log_prealloc_bytes;
+	}
+#endif
+
+	return;
+}
+
+int msg_open_log(const char* path) {
+	int new_fd;
+
+#if DO_MSG_SAFETY_CHECKS
+	if (path == NULL || path[0] == 0) {
+		return -EINVAL;
+	}
+#endif
+
+	if ((new_fd = open_log_fd(path)) < 0) {
+		return new_fd;
+	}
+	swap_log_fd(new_fd);
+	set_log_path(path);
+
 #if MSG_USE_MALLOC
 	if (config.log_name != NULL && config.log_name != default_log_name) {
 		free(config.log_name);
@@ -457,14 +1570,19 @@ int msg_close_log(void) {
 		}
 	}
 	config.log_fd = -1;
+	forget_log_state();
 
 	return ret;
 }
 #endif // MSG_USE_UNIX_IO
+#if !MSG_USE_RING_LOG
+# define RING_LOG_MESSAGE(_prefix_, _suffix_, _fmt_) ((void )0)
+# define RING_LOG_VMESSAGE(_prefix_, _suffix_, _fmt_, _args_) ((void )0)
+#endif
 
 bool msg_ask(bool ans_default, bool ans_forced, const char *restrict fmt, ...) {
 	va_list args;
-	char answer[8] = { 0 };
+	const char *answer;
 	const char *def_str;
 	bool ans;
 
@@ -503,7 +1621,11 @@ bool msg_ask(bool ans_default, bool ans_forced, const char *restrict fmt, ...) {
 			return ans;
 		}
 
-		msg_gets(answer, 8);
+		// Only the first letter matters; the rest of the line is discarded.
+		if (msg_getline(&answer) <= 0) {
+			//msg_puts(def_str);
+			return ans;
+		}
 		switch (answer[0]) {
 			case 'y':
 			case 'Y':
@@ -513,11 +1635,6 @@ bool msg_ask(bool ans_default, bool ans_forced, const char *restrict fmt, ...) {
 			case 'N':
 				return false;
 				break;
-			case 0:
-			case '\n':
-				//msg_puts(def_str);
-				return ans;
-				break;
 		}
 	}
 
@@ -532,12 +1649,28 @@ void msg_log(const char *restrict fmt, ...) {
 	}
 #endif
 
+	RING_LOG_MESSAGE(NULL, NULL, fmt);
+
 	if (WRITE_ALLOWED(log)) {
 		va_list args;
 
 		if (CONFIG_FLAG_IS_SET(MSG_FLAG_LOG_PRINTTIME) && config.print_log_time != NULL) {
-			char time_buf[MSG_STR_BYTES];
-			log_printf("[%s] ", config.print_log_time(time_buf, SIZEOF_ARRAY(time_buf)));
+#if MSG_USE_UNIX_IO
+			if (config.print_log_time == msg_print_log_time_cached) {
+				update_log_time_cache();
+				if (log_time_cache.second >= 0) {
+					log_write(log_time_cache.prefix, LOG_TIME_PREFIX_LEN);
+				}
+			} else
+#endif
+			{
+				char time_buf[MSG_STR_BYTES];
+				const char *ts = config.print_log_time(time_buf, SIZEOF_ARRAY(time_buf));
+
+				log_write("[", 1);
+				log_write(ts, strlen(ts));
+				log_write("] ", 2);
+			}
 		}
 
 		va_start(args, fmt);
@@ -545,6 +1678,10 @@ void msg_log(const char *restrict fmt, ...) {
 		va_end(args);
 
 		log_write(newline, newline_len);
+
+#if MSG_USE_UNIX_IO
+		maintain_log();
+#endif
 	}
 
 	return;
@@ -560,6 +1697,11 @@ void msg_error(const char *restrict fmt, ...) {
 	}
 #endif
 
+	if (!RATE_LIMIT_ALLOWS(fmt, RATE_LIMIT_ERROR)) {
+		return;
+	}
+	RING_LOG_MESSAGE(config.error_prefix, NULL, fmt);
+
 	if (config.program_name[0] != 0) {
 		stderr_printf("%s: ", config.program_name);
 	}
@@ -583,9 +1725,14 @@ static void _msg_errno(int errnum, const char *restrict fmt, va_list args) {
 		return;
 	}
 #endif
+
+	if (!RATE_LIMIT_ALLOWS(fmt, RATE_LIMIT_ERROR)) {
+		return;
+	}
 	if (errnum < 0) {
 		errnum = -errnum;
 	}
+	RING_LOG_VMESSAGE(config.error_prefix, strerror(errnum), fmt, args);
 
 	if (config.program_name[0] != 0) {
 		stderr_printf("%s: ", config.program_name);
@@ -629,9 +1776,14 @@ void msg_warnno(int errnum, const char *restrict fmt, ...) {
 		return;
 	}
 #endif
+
+	if (!RATE_LIMIT_ALLOWS(fmt, RATE_LIMIT_WARN)) {
+		return;
+	}
 	if (errnum < 0) {
 		errnum = -errnum;
 	}
+	RING_LOG_MESSAGE(config.warn_prefix, strerror(errnum), fmt);
 
 	if (config.program_name[0] != 0) {
 		stderr_printf("%s: ", config.program_name);
@@ -657,6 +1809,11 @@ void msg_warn(const char *restrict fmt, ...) {
 	}
 #endif
 
+	if (!RATE_LIMIT_ALLOWS(fmt, RATE_LIMIT_WARN)) {
+		return;
+	}
+	RING_LOG_MESSAGE(config.warn_prefix, NULL, fmt);
+
 	if (config.program_name[0] != 0) {
 		stderr_printf("%s: ", config.program_name);
 	}
@@ -673,6 +1830,15 @@ void msg_warn(const char *restrict fmt, ...) {
 	return;
 }
 
+static void print_message(const char *restrict fmt, va_list args) {
+	if (config.program_name[0] != 0) {
+		stdout_printf("%s: ", config.program_name);
+	}
+	stdout_vprintf(fmt, args);
+	stdout_write(newline, newline_len);
+
+	return;
+}
 void msg_print(int8_t priority, const char *restrict fmt, ...) {
 	ulib_assert(fmt != NULL);
 #if DO_MSG_SAFETY_CHECKS
@@ -681,18 +1847,34 @@ void msg_print(int8_t priority, const char *restrict fmt, ...) {
 	}
 #endif
 
+	RING_LOG_MESSAGE(NULL, NULL, fmt);
+
 	if (priority <= config.verbosity) {
 		va_list args;
 
-		if (config.program_name[0] != 0) {
-			stdout_printf("%s: ", config.program_name);
-		}
-
 		va_start(args, fmt);
-		stdout_vprintf(fmt, args);
+		print_message(fmt, args);
 		va_end(args);
+	}
+
+	return;
+}
+void _msg_print(bool print, const char *restrict fmt, ...) {
+	ulib_assert(fmt != NULL);
+#if DO_MSG_SAFETY_CHECKS
+	if (fmt == NULL) {
+		return;
+	}
+#endif
 
-		stdout_write(newline, newline_len);
+	RING_LOG_MESSAGE(NULL, NULL, fmt);
+
+	if (print) {
+		va_list args;
+
+		va_start(args, fmt);
+		print_message(fmt, args);
+		va_end(args);
 	}
 
 	return;
@@ -708,6 +1890,8 @@ void msg_debug(const char *restrict fmt, ...) {
 	}
 # endif
 
+	RING_LOG_MESSAGE(config.debug_prefix, NULL, fmt);
+
 	if (config.program_name[0] != 0) {
 		stderr_printf("%s: ", config.program_name);
 	}
@@ -25,10 +25,12 @@
 #include "printf.h"
 #if ULIB_ENABLE_PRINTF
 
-#include "debug.h"
 #include "ascii.h"
+#include "cstrings.h"
+#include "debug.h"
 #include "util.h"
 
+#include <float.h>
 #include <limits.h>
 #include <string.h>
 
@@ -48,6 +50,8 @@
 // This also controls variable precision
 #define ALLOW_VARIABLE_WIDTH (PRINTF_ALLOW_VARIABLE_WIDTHS)
 #define ALLOW_EXOTIC_TYPES (PRINTF_ALLOW_UNCOMMON_INTS)
+#define ALLOW_FLOATS (PRINTF_ALLOW_FLOATS)
+#define SHORTEST_G (PRINTF_FLOAT_SHORTEST_G)
 
 // Not parsing fields when they're ignored causes the arguments to become out
 // of sync with va_arg(), which can cause crashes or security problems.
@@ -68,6 +72,18 @@
 # define PRINTF_BUFFER_BYTES (((PRINTF_MAX_INT_BYTES * 8U) / 3U) + 1)
 #endif
 
+#if ALLOW_FLOATS
+# if DBL_MANT_DIG != 53 || DBL_MAX_EXP != 1024
+#  error "PRINTF_ALLOW_FLOATS requires IEEE 754 double-precision doubles"
+# endif
+# if PRINTF_FLOAT_MAX_DIGITS < 17 || PRINTF_FLOAT_MAX_DIGITS > 1000
+#  error "PRINTF_FLOAT_MAX_DIGITS must be between 17 and 1000"
+# endif
+#endif
+
+
+// Padding is written in chunks of this many characters.
+static const char pad_spaces[16] = "                ";
 
 void ulib_printf(void (*pputc)(uint_fast8_t c), const char *restrict fmt, ...) {
 	va_list arp;
@@ -78,6 +94,97 @@ void ulib_printf(void (*pputc)(uint_fast8_t c), const char *restrict fmt, ...) {
 
 	return;
 }
+void ulib_printf_sink(const printf_sink_t *sink, const char *restrict fmt, ...) {
+	va_list arp;
+
+	va_start(arp, fmt);
+	ulib_vprintf_sink(sink, fmt, arp);
+	va_end(arp);
+
+	return;
+}
+
+// The per-character interface is implemented as a sink which passes each
+// character in a span to pputc().
+typedef struct {
+	void (*pputc)(uint_fast8_t c);
+} putc_sink_ctx_t;
+static void putc_sink_write(void *ctx, const char *buf, size_t len) {
+	void (*pputc)(uint_fast8_t c) = ((putc_sink_ctx_t *)ctx)->pputc;
+
+	for (size_t i = 0; i < len; ++i) {
+		pputc((uint8_t )buf[i]);
+	}
+
+	return;
+}
+
+// ulib_vsnprintf() copies spans straight into the caller's buffer and
+// counts everything, including what doesn't fit.
+typedef struct {
+	char *buf;
+	// The space available for characters, excluding the trailing NUL.
+	size_t room;
+	size_t len;
+} snprintf_sink_ctx_t;
+static void snprintf_sink_write(void *ctx, const char *buf, size_t len) {
+	snprintf_sink_ctx_t *c = ctx;
+
+	if (c->len < c->room) {
+		size_t n = c->room - c->len;
+
+		if (n > len) {
+			n = len;
+		}
+		memcpy(&c->buf[c->len], buf, n);
+	}
+	c->len += len;
+
+	return;
+}
+size_t ulib_snprintf(char *restrict buf, size_t size, const char *restrict fmt, ...) {
+	va_list arp;
+	size_t len;
+
+	va_start(arp, fmt);
+	len = ulib_vsnprintf(buf, size, fmt, arp);
+	va_end(arp);
+
+	return len;
+}
+size_t ulib_vsnprintf(char *restrict buf, size_t size, const char *restrict fmt, va_list arp) {
+	snprintf_sink_ctx_t ctx = { buf, 0, 0 };
+	printf_sink_t sink = { snprintf_sink_write, &ctx };
+
+	ulib_assert((buf != NULL) || (size == 0));
+
+	if (DO_PRINTF_SAFETY_CHECKS) {
+		if (buf == NULL) {
+			size = 0;
+		}
+	}
+
+	if (size > 0) {
+		ctx.room = size - 1U;
+	}
+	ulib_vprintf_sink(&sink, fmt, arp);
+	if (size > 0) {
+		buf[(ctx.len < ctx.room) ? ctx.len : ctx.room] = 0;
+	}
+
+	return ctx.len;
+}
+
+static void print_spaces(const printf_sink_t *sink, uint count) {
+	while (count > 0) {
+		uint n = (count > sizeof(pad_spaces)) ? (uint )sizeof(pad_spaces) : count;
+
+		sink->write(sink->ctx, pad_spaces, n);
+		count -= n;
+	}
+
+	return;
+}
 
 #if PACK_OPT_STRUCT
 typedef struct {
@@ -93,6 +200,7 @@ typedef struct {
 	bool is_negative :1 ;
 	bool lower_hex   :1 ;
 	bool alt_form    :1 ;
+	bool has_precision :1 ;
 } printf_opts_t;
 #else
 typedef struct {
@@ -108,9 +216,11 @@ typedef struct {
 	bool is_negative ;
 	bool lower_hex   ;
 	bool alt_form    ;
+	bool has_precision ;
 } printf_opts_t;
 #endif
 #define OPTS_DEFAULT { 0 }
+#define OP_DEFAULT { 0 }
 
 typedef enum {
 	POS_SIGN_NONE = 0,
@@ -148,7 +258,7 @@ typedef enum {
 // negative to positive after copying to our final (unsigned) variable.
 #define GET_SIGNED_INT_ARG(_var_, _type_, _max_neg_) \
 	do { \
-		_type_ tmp = va_arg(arp, _type_); \
+		_type_ tmp = va_arg(*arp, _type_); \
 		(_var_) = (printf_uint_t )tmp; \
 		if (tmp < 0) { \
 			(_var_) ^= PRINTF_UINT_MAX; \
@@ -158,15 +268,19 @@ typedef enum {
 	} while (0)
 #define GET_UNSIGNED_INT_ARG(_var_, _type_, _va_type_) \
 	do { \
-		_va_type_ tmp = va_arg(arp, _va_type_); \
+		_va_type_ tmp = va_arg(*arp, _va_type_); \
 		(_var_) = (printf_uint_t )((_type_ )tmp); \
 	} while (0)
 
-static void print_int(void(*pputc)(uint_fast8_t c), printf_uint_t n, const printf_opts_t *opts) {
-	uint8_t print_buf[PRINTF_BUFFER_BYTES];
-	printf_int_len_t buf_i = 0;
+static void print_int(const printf_sink_t *sink, printf_uint_t n, const printf_opts_t *opts) {
+	// The digits are filled in from the end of the buffer so that they're in
+	// the right order to be written out in one go.
+	char print_buf[PRINTF_BUFFER_BYTES];
+	char prefix_buf[2];
+	printf_int_len_t buf_i = PRINTF_BUFFER_BYTES;
+	printf_int_len_t len;
 	uint_fast8_t base;
-	uint_fast8_t prefix;
+	uint_fast8_t prefix = 0;
 	printf_int_len_t pad_chars;
 	bool left_adjust;
 
@@ -174,117 +288,109 @@ static void print_int(void(*pputc)(uint_fast8_t c), printf_uint_t n, const print
 	// int while also allowing anything small enough to be printed
 	n &= PRINTF_UINT_VALUE_MAX;
 
-	base = (PRINT_BINARY || base != 2) ? opts->int_base : 8;
+	base = (PRINT_BINARY || opts->int_base != 2) ? opts->int_base : 8;
 	left_adjust = (ALLOW_LEFT_ADJUST) ? opts->left_adjust : false;
 
-	prefix = (opts->is_signed && (opts->is_negative || opts->pos_sign != 0)) ? 1 : 0;
-	if (USE_ALT_FORM && opts->alt_form && base != 10) {
-		if (!PRINTF_USE_o_FOR_OCTAL && base == 8) {
-			prefix += 1;
-		} else {
-			prefix += 2;
+	if (opts->is_signed) {
+		if (opts->is_negative) {
+			prefix_buf[prefix++] = '-';
+		} else if (opts->pos_sign == POS_SIGN_BLANK) {
+			prefix_buf[prefix++] = ' ';
+		} else if (opts->pos_sign == POS_SIGN_PLUS) {
+			prefix_buf[prefix++] = '+';
+		}
+	} else if (USE_ALT_FORM && opts->alt_form && base != 10) {
+		prefix_buf[prefix++] = '0';
+		if (PRINTF_USE_o_FOR_OCTAL && base == 8) {
+			prefix_buf[prefix++] = 'o';
+		} else if (PRINT_BINARY && base == 2) {
+			prefix_buf[prefix++] = 'b';
+		} else if (base == 16) {
+			prefix_buf[prefix++] = 'x';
 		}
 	}
 
-	if (n == 0) {
-		print_buf[0] = '0';
-		++buf_i;
+	if (base == 10) {
+		char *start;
+
+#if PRINTF_MAX_INT_BYTES <= 4
+		start = cstring_from_uint32_end(&print_buf[PRINTF_BUFFER_BYTES], (uint32_t )n);
+#else
+		start = cstring_from_uint64_end(&print_buf[PRINTF_BUFFER_BYTES], (uint64_t )n);
+#endif
+		buf_i = (printf_int_len_t )(start - print_buf);
+	} else if (n == 0) {
+		print_buf[--buf_i] = '0';
 	} else if (PRINT_BINARY && base == 2) {
-		for (; n != 0; ++buf_i, n >>= 1) {
-			print_buf[buf_i] = ((n & 0x01U) == 0) ? '0' : '1';
+		for (; n != 0; n >>= 1) {
+			print_buf[--buf_i] = ((n & 0x01U) == 0) ? '0' : '1';
 		}
 	} else {
 		uint_fast8_t c;
 		uint_fast8_t xmod = (ALLOW_LOWERCASE_HEX && opts->lower_hex) ? 'a' - 0x0AU : 'A' - 0x0AU;
 
-		for (; n != 0; ++buf_i) {
+		for (; n != 0;) {
 			c = (uint_fast8_t )(n % base);
 			n /= base;
 
-			print_buf[buf_i] = (c > 9) ? c + xmod : c + '0';
+			print_buf[--buf_i] = (char )((c > 9) ? c + xmod : c + '0');
 		}
 	}
+	len = PRINTF_BUFFER_BYTES - buf_i;
 
 	if (USE_PRECISION && opts->precision > 0) {
 		uint_fast8_t precision;
 
 		precision = (opts->precision > PRINTF_BUFFER_BYTES) ? PRINTF_BUFFER_BYTES : opts->precision;
 
-		for (; buf_i < precision; ++buf_i) {
-			print_buf[buf_i] = '0';
+		for (; len < precision; ++len) {
+			print_buf[--buf_i] = '0';
 		}
 	} else if (ALLOW_ZERO_PADDING && !left_adjust && opts->pad_0) {
-		printf_int_len_t w = buf_i + prefix;
+		printf_int_len_t w = len + prefix;
 
 		w = (opts->width > w) ? opts->width - w : 0;
-		for (; w > 0; ++buf_i, --w) {
-			print_buf[buf_i] = '0';
+		// Any padding that doesn't fit is made up with spaces below.
+		for (; (w > 0) && (buf_i > 0); ++len, --w) {
+			print_buf[--buf_i] = '0';
 		}
 	}
 
-	pad_chars = buf_i + prefix;
+	pad_chars = len + prefix;
 	pad_chars = (opts->width > pad_chars) ? opts->width - pad_chars : 0;
 	if (!left_adjust) {
-		for (; pad_chars != 0; --pad_chars) {
-			pputc(' ');
-		}
+		print_spaces(sink, (uint )pad_chars);
 	}
 
-	if (opts->is_signed) {
-		if (opts->is_negative) {
-			pputc('-');
-		} else if (opts->pos_sign == POS_SIGN_BLANK) {
-			pputc(' ');
-		} else if (opts->pos_sign == POS_SIGN_PLUS) {
-			pputc('+');
-		}
-	} else if (USE_ALT_FORM && opts->alt_form && base != 10) {
-		pputc('0');
-		if (PRINTF_USE_o_FOR_OCTAL && base == 8) {
-			pputc('o');
-		} else if (PRINT_BINARY && base == 2) {
-			pputc('b');
-		} else if (base == 16) {
-			pputc('x');
-		}
+	if (prefix > 0) {
+		sink->write(sink->ctx, prefix_buf, prefix);
 	}
 
-	if (GROUP_1000s && base == 10 && opts->group_1000s && buf_i > 3) {
-		uint_fast8_t places = (uint_fast8_t )(3 - (buf_i % 3));
-
-		while (buf_i != 0) {
-			--buf_i;
-
-			if (places == 3) {
-				places = 0;
-				if (buf_i > 0) {
-					pputc(PRINTF_INT_GROUPING_CHAR);
-				}
-			}
-			if (ASCII_IS_DIGIT(print_buf[buf_i])) {
-				++places;
-			}
+	if (GROUP_1000s && base == 10 && opts->group_1000s && len > 3) {
+		const char sep = PRINTF_INT_GROUPING_CHAR;
+		printf_int_len_t group = len % 3U;
 
-			pputc(print_buf[buf_i]);
+		if (group == 0) {
+			group = 3;
 		}
-	} else {
-		while (buf_i != 0) {
-			--buf_i;
-			pputc(print_buf[buf_i]);
+		sink->write(sink->ctx, &print_buf[buf_i], group);
+		for (buf_i += group; buf_i < PRINTF_BUFFER_BYTES; buf_i += 3U) {
+			sink->write(sink->ctx, &sep, 1);
+			sink->write(sink->ctx, &print_buf[buf_i], 3);
 		}
+	} else {
+		sink->write(sink->ctx, &print_buf[buf_i], len);
 	}
 
-	if (ALLOW_LEFT_ADJUST) {
-		for (; pad_chars != 0; --pad_chars) {
-			pputc(' ');
-		}
+	if (ALLOW_LEFT_ADJUST && left_adjust) {
+		print_spaces(sink, (uint )pad_chars);
 	}
 
 	//return MAX(print_chars, opts->width);
 	return;
 }
 
-static void print_string(void(*pputc)(uint_fast8_t c), const char *s, const printf_opts_t *opts) {
+static void print_string(const printf_sink_t *sink, const char *s, const printf_opts_t *opts) {
 	uint len = 0;
 
 	if (DO_PRINTF_SAFETY_CHECKS && s == NULL) {
@@ -292,394 +398,1071 @@ static void print_string(void(*pputc)(uint_fast8_t c), const char *s, const prin
 	}
 
 	if (PAD_STRINGS) {
-		len = (uint )strlen(s);
+		uint pad_chars;
+
 		if (USE_PRECISION && opts->precision > 0) {
-			len = MIN(len, opts->precision);
+			// The string may not be NUL-terminated if a precision is given.
+			const char *end = memchr(s, 0, opts->precision);
+
+			len = (end != NULL) ? (uint )(end - s) : opts->precision;
+		} else {
+			len = (uint )strlen(s);
 		}
 
-		uint pad_chars = (opts->width > len) ? opts->width - len : 0;
+		pad_chars = (opts->width > len) ? opts->width - len : 0;
 		if (!ALLOW_LEFT_ADJUST || !opts->left_adjust) {
-			for (; pad_chars != 0; --pad_chars) {
-				pputc(' ');
-			}
+			print_spaces(sink, pad_chars);
 		}
 
-		for (uint i = 0; i < len; ++i) {
-			pputc((uint_fast8_t )s[i]);
-		}
+		sink->write(sink->ctx, s, len);
 
-		if (ALLOW_LEFT_ADJUST) {
-			for (; pad_chars != 0; --pad_chars) {
-				pputc(' ');
-			}
+		if (ALLOW_LEFT_ADJUST && opts->left_adjust) {
+			print_spaces(sink, pad_chars);
 		}
 	} else {
-		//for (; *s != 0; ++s, ++len) {
-		for (; *s != 0; ++s) {
-			pputc((uint_fast8_t )*s);
-		}
+		sink->write(sink->ctx, s, strlen(s));
 	}
 
 	//return MAX(len, opts->width);
 	return;
 }
 
-static void print_char(void(*pputc)(uint_fast8_t c), char c, const printf_opts_t *opts) {
+static void print_char(const printf_sink_t *sink, char c, const printf_opts_t *opts) {
 	if (DO_PRINTF_SAFETY_CHECKS && (c == 0)) {
 		c = '.';
 		//return;
 	}
 
 	if (PAD_CHARS) {
-		uint pad_chars = (opts->width > 0) ? opts->width - 1 : 0;
+		uint pad_chars = (opts->width > 0) ? opts->width - 1U : 0;
 
 		if (!ALLOW_LEFT_ADJUST || !opts->left_adjust) {
-			for (; pad_chars != 0; --pad_chars) {
-				pputc(' ');
+			print_spaces(sink, pad_chars);
+		}
+
+		sink->write(sink->ctx, &c, 1);
+
+		if (ALLOW_LEFT_ADJUST && opts->left_adjust) {
+			print_spaces(sink, pad_chars);
+		}
+	} else {
+		sink->write(sink->ctx, &c, 1);
+	}
+
+	//return MAX(1, opts->width);
+	return;
+}
+
+#if ALLOW_FLOATS
+//
+// Doubles are converted to decimal exactly with big integer arithmetic, using
+// the method of Steele & White and Burger & Dybvig. It's slower than the
+// table-driven algorithms like Ryu but it's small, needs no tables, and is
+// always correctly rounded.
+//
+// The value and the distance to its neighbors are kept as the ratios r/s and
+// m/s. The largest value that needs to be held is a bit over 2^1085, plus
+// up to 31 bits of normalization.
+#define BIGNUM_WORDS 38U
+typedef struct {
+	uint_fast8_t len;
+	uint32_t w[BIGNUM_WORDS];
+} bignum_t;
+
+static void bn_set(bignum_t *a, uint64_t v) {
+	for (a->len = 0; v != 0; v >>= 32) {
+		a->w[a->len++] = (uint32_t )v;
+	}
+
+	return;
+}
+static void bn_mul_small(bignum_t *a, uint32_t m) {
+	uint64_t carry = 0;
+
+	for (uint_fast8_t i = 0; i < a->len; ++i) {
+		carry += (uint64_t )a->w[i] * m;
+		a->w[i] = (uint32_t )carry;
+		carry >>= 32;
+	}
+	if (carry != 0) {
+		a->w[a->len++] = (uint32_t )carry;
+	}
+
+	return;
+}
+static void bn_mul_pow10(bignum_t *a, uint_fast16_t n) {
+	uint32_t m = 1;
+
+	for (; n >= 9U; n -= 9U) {
+		bn_mul_small(a, 1000000000U);
+	}
+	for (; n > 0; --n) {
+		m *= 10U;
+	}
+	if (m > 1) {
+		bn_mul_small(a, m);
+	}
+
+	return;
+}
+static void bn_shl(bignum_t *a, uint_fast16_t bits) {
+	uint_fast8_t words = (uint_fast8_t )(bits / 32U);
+
+	if (a->len == 0) {
+		return;
+	}
+
+	bits %= 32U;
+	if (bits != 0) {
+		uint32_t carry = 0;
+
+		for (uint_fast8_t i = 0; i < a->len; ++i) {
+			uint32_t tmp = a->w[i];
+
+			a->w[i] = (tmp << bits) | carry;
+			carry = tmp >> (32U - bits);
+		}
+		if (carry != 0) {
+			a->w[a->len++] = carry;
+		}
+	}
+	if (words != 0) {
+		memmove(&a->w[words], a->w, a->len * sizeof(a->w[0]));
+		memset(a->w, 0, words * sizeof(a->w[0]));
+		a->len += words;
+	}
+
+	return;
+}
+static int_fast8_t bn_cmp(const bignum_t *a, const bignum_t *b) {
+	if (a->len != b->len) {
+		return (a->len > b->len) ? 1 : -1;
+	}
+	for (uint_fast8_t i = a->len; i-- > 0;) {
+		if (a->w[i] != b->w[i]) {
+			return (a->w[i] > b->w[i]) ? 1 : -1;
+		}
+	}
+
+	return 0;
+}
+// res may be the same as a or b.
+static void bn_add(bignum_t *res, const bignum_t *a, const bignum_t *b) {
+	const bignum_t *longer = (a->len >= b->len) ? a : b;
+	const bignum_t *shorter = (a->len >= b->len) ? b : a;
+	uint_fast8_t len = longer->len;
+	uint64_t carry = 0;
+
+	for (uint_fast8_t i = 0; i < len; ++i) {
+		carry += longer->w[i];
+		if (i < shorter->len) {
+			carry += shorter->w[i];
+		}
+		res->w[i] = (uint32_t )carry;
+		carry >>= 32;
+	}
+	if (carry != 0) {
+		res->w[len++] = (uint32_t )carry;
+	}
+	res->len = len;
+
+	return;
+}
+// Subtract q*b from a; the result must not be negative.
+static void bn_mul_sub(bignum_t *a, const bignum_t *b, uint32_t q) {
+	uint64_t borrow = 0;
+
+	for (uint_fast8_t i = 0; i < a->len; ++i) {
+		uint64_t sub = borrow;
+
+		if (i < b->len) {
+			sub += (uint64_t )b->w[i] * q;
+		}
+		borrow = sub >> 32;
+		if ((uint32_t )sub > a->w[i]) {
+			++borrow;
+		}
+		a->w[i] -= (uint32_t )sub;
+	}
+	while ((a->len > 0) && (a->w[a->len-1] == 0)) {
+		--a->len;
+	}
+
+	return;
+}
+// Divide r by s, leaving the remainder in r. The quotient must be < 10 and
+// s must be normalized so that the high bit of its top word is set, which
+// makes the first estimate of the quotient at most 1 too small.
+static uint_fast8_t bn_div_digit(bignum_t *r, const bignum_t *s) {
+	uint_fast8_t n = s->len;
+	uint64_t top;
+	uint32_t q;
+
+	if (r->len < n) {
+		return 0;
+	}
+
+	top = r->w[n-1];
+	if (r->len > n) {
+		top |= (uint64_t )r->w[n] << 32;
+	}
+	q = (uint32_t )(top / ((uint64_t )s->w[n-1] + 1U));
+	if (q != 0) {
+		bn_mul_sub(r, s, q);
+	}
+	while (bn_cmp(r, s) >= 0) {
+		bn_mul_sub(r, s, 1);
+		++q;
+	}
+
+	return (uint_fast8_t )q;
+}
+
+typedef enum {
+	FLOAT_SHORTEST = 0,
+	// Generate a given number of significant digits
+	FLOAT_SIGNIFICANT = 1,
+	// Generate digits down to a given place after the decimal point
+	FLOAT_FRACTION = 2
+} float_mode_t;
+
+// Decimal digits for a double, with the first digit in the 10^exp place.
+// Any digits past 'len' are 0.
+typedef struct {
+	char digits[PRINTF_FLOAT_MAX_DIGITS];
+	uint_fast16_t len;
+	int_fast16_t exp;
+} float_digits_t;
+
+// Round the digits up by one unit in the last place.
+static void round_digits_up(float_digits_t *fd) {
+	uint_fast16_t i = fd->len;
+
+	for (; (i > 0) && (fd->digits[i-1] == '9'); --i) {
+	}
+	if (i == 0) {
+		fd->digits[0] = '1';
+		fd->len = 1;
+		++fd->exp;
+	} else {
+		++fd->digits[i-1];
+		fd->len = i;
+	}
+
+	return;
+}
+
+// Convert the magnitude of a finite, non-zero double (given as its bits) to
+// decimal digits.
+static void float_to_digits(uint64_t bits, float_digits_t *fd, float_mode_t mode, int_fast16_t count) {
+	bignum_t r, s, m, tmp;
+	uint64_t f = bits & 0x000FFFFFFFFFFFFFU;
+	int_fast16_t e = (int_fast16_t )((bits >> 52) & 0x7FFU);
+	int_fast16_t k;
+	int_fast16_t max_len;
+	uint_fast16_t shift;
+	bool unequal_gaps, even;
+	uint_fast8_t d;
+
+	if (e == 0) {
+		e = -1074;
+	} else {
+		f |= 0x0010000000000000U;
+		e -= 1075;
+	}
+	// The gap to the next smaller double is half the gap to the next larger
+	// one at the bottom of each binade.
+	unequal_gaps = (e > -1074) && (f == 0x0010000000000000U);
+	even = ((f & 0x01U) == 0);
+
+	// v = r/s and the distance to each neighbor is m/s, or 2m/s for the
+	// larger neighbor if the gaps are unequal.
+	bn_set(&r, f << (unequal_gaps ? 2 : 1));
+	bn_set(&s, (unequal_gaps) ? 4 : 2);
+	bn_set(&m, 1);
+	if (e >= 0) {
+		bn_shl(&r, (uint_fast16_t )e);
+		bn_shl(&m, (uint_fast16_t )e);
+	} else {
+		bn_shl(&s, (uint_fast16_t )-e);
+	}
+
+	// Estimate floor(log10(v)) from the binary exponent and scale so that
+	// 1 <= r/s < 10; the estimate may be off by one either way.
+	k = e;
+	for (uint64_t tmp_f = f; tmp_f > 1; tmp_f >>= 1) {
+		++k;
+	}
+	if (k >= 0) {
+		k = (int_fast16_t )((k * 1233) >> 12);
+		bn_mul_pow10(&s, (uint_fast16_t )k);
+	} else {
+		k = (int_fast16_t )-(((-k * 1233) + 4095) >> 12);
+		bn_mul_pow10(&r, (uint_fast16_t )-k);
+		bn_mul_pow10(&m, (uint_fast16_t )-k);
+	}
+	tmp = s;
+	bn_mul_small(&tmp, 10);
+	if (bn_cmp(&r, &tmp) >= 0) {
+		s = tmp;
+		++k;
+	} else if (bn_cmp(&r, &s) < 0) {
+		bn_mul_small(&r, 10);
+		bn_mul_small(&m, 10);
+		--k;
+	}
+
+	switch (mode) {
+	case FLOAT_SIGNIFICANT:
+		max_len = count;
+		break;
+	case FLOAT_FRACTION:
+		max_len = (int_fast16_t )(k + 1 + count);
+		if (max_len < 0) {
+			// Rounds to 0.
+			fd->len = 0;
+			fd->exp = k;
+			return;
+		} else if (max_len == 0) {
+			// The value may still round up to 1 in the place above the first
+			// digit, so compare the remainder against that.
+			bn_mul_small(&s, 10);
+		}
+		break;
+	default:
+		max_len = PRINTF_FLOAT_MAX_DIGITS;
+		break;
+	}
+	if (max_len > (int_fast16_t )PRINTF_FLOAT_MAX_DIGITS) {
+		max_len = PRINTF_FLOAT_MAX_DIGITS;
+	}
+
+	shift = 0;
+	for (uint32_t top = s.w[s.len-1]; top < 0x80000000U; top <<= 1) {
+		++shift;
+	}
+	bn_shl(&r, shift);
+	bn_shl(&s, shift);
+	bn_shl(&m, shift);
+
+	fd->exp = k;
+	fd->len = 0;
+
+	if (mode == FLOAT_SHORTEST) {
+		// Stop as soon as the digits so far identify v, rounding the last one
+		// in whichever direction stays closest.
+		while (true) {
+			int_fast8_t cmp;
+			bool low, high;
+
+			d = bn_div_digit(&r, &s);
+			cmp = bn_cmp(&r, &m);
+			low = (even) ? (cmp <= 0) : (cmp < 0);
+			bn_add(&tmp, &r, &m);
+			if (unequal_gaps) {
+				bn_add(&tmp, &tmp, &m);
 			}
+			cmp = bn_cmp(&tmp, &s);
+			high = (even) ? (cmp >= 0) : (cmp > 0);
+
+			if (low || high || ((int_fast16_t )fd->len == max_len - 1)) {
+				// If either digit would do, use the closer one.
+				if (low == high) {
+					bn_add(&tmp, &r, &r);
+					cmp = bn_cmp(&tmp, &s);
+					high = ((cmp > 0) || ((cmp == 0) && ((d & 0x01U) != 0)));
+				}
+				fd->digits[fd->len++] = (char )('0' + d);
+				if (high) {
+					round_digits_up(fd);
+				}
+				break;
+			}
+			fd->digits[fd->len++] = (char )('0' + d);
+			bn_mul_small(&r, 10);
+			bn_mul_small(&m, 10);
 		}
+	} else {
+		int_fast8_t cmp;
 
-		pputc((uint_fast8_t )c);
+		while (((int_fast16_t )fd->len < max_len) && (r.len != 0)) {
+			if (fd->len != 0) {
+				bn_mul_small(&r, 10);
+			}
+			d = bn_div_digit(&r, &s);
+			fd->digits[fd->len++] = (char )('0' + d);
+		}
+		// Round half to even, like the standard library does by default.
+		bn_add(&tmp, &r, &r);
+		cmp = bn_cmp(&tmp, &s);
+		if ((cmp > 0) || ((cmp == 0) && (fd->len > 0) && (((uint_fast8_t )fd->digits[fd->len-1] & 0x01U) != 0))) {
+			round_digits_up(fd);
+		}
+	}
+
+	while ((fd->len > 0) && (fd->digits[fd->len-1] == '0')) {
+		--fd->len;
+	}
+
+	return;
+}
 
-		if (ALLOW_LEFT_ADJUST) {
-			for (; pad_chars != 0; --pad_chars) {
-				pputc(' ');
+// Print 'count' digits starting at digits[start], where any digits outside
+// of the buffer are 0.
+static void print_digits(const printf_sink_t *sink, const float_digits_t *fd, int_fast16_t start, uint_fast16_t count) {
+	static const char pad_zeros[16] = "0000000000000000";
+	uint_fast16_t n;
+
+	while (count > 0) {
+		if ((start >= 0) && (start < (int_fast16_t )fd->len)) {
+			n = fd->len - (uint_fast16_t )start;
+			n = (count > n) ? n : count;
+			sink->write(sink->ctx, &fd->digits[start], n);
+		} else {
+			n = (count > sizeof(pad_zeros)) ? (uint_fast16_t )sizeof(pad_zeros) : count;
+			if ((start < 0) && (n > (uint_fast16_t )-start)) {
+				n = (uint_fast16_t )-start;
 			}
+			sink->write(sink->ctx, pad_zeros, n);
+		}
+		start = (int_fast16_t )(start + (int_fast16_t )n);
+		count -= n;
+	}
+
+	return;
+}
+
+static void print_float(const printf_sink_t *sink, double v, const printf_opts_t *opts, uint_fast8_t c) {
+	float_digits_t fd;
+	uint64_t bits;
+	char prefix = 0;
+	char exp_buf[5];
+	uint_fast8_t exp_len = 0;
+	uint_fast16_t int_len, frac_len, len;
+	uint_fast16_t precision = (opts->has_precision) ? opts->precision : 6U;
+	uint_fast16_t pad_chars;
+	bool upper = ascii_is_upper((uint8_t )c);
+	bool left_adjust = (ALLOW_LEFT_ADJUST) ? opts->left_adjust : false;
+	bool alt_form = (USE_ALT_FORM) ? opts->alt_form : false;
+	bool e_style;
+	bool point;
+
+	memcpy(&bits, &v, sizeof(bits));
+	if ((bits & 0x8000000000000000U) != 0) {
+		prefix = '-';
+	} else if (opts->pos_sign == POS_SIGN_BLANK) {
+		prefix = ' ';
+	} else if (opts->pos_sign == POS_SIGN_PLUS) {
+		prefix = '+';
+	}
+	bits &= 0x7FFFFFFFFFFFFFFFU;
+	c = ascii_to_lower((uint8_t )c);
+
+	if (bits >= 0x7FF0000000000000U) {
+		const char *s;
+
+		if (bits == 0x7FF0000000000000U) {
+			s = (upper) ? "INF" : "inf";
+		} else {
+			s = (upper) ? "NAN" : "nan";
+		}
+		len = (prefix != 0) ? 4 : 3;
+		pad_chars = (opts->width > len) ? opts->width - len : 0;
+		if (!left_adjust) {
+			print_spaces(sink, (uint )pad_chars);
+		}
+		if (prefix != 0) {
+			sink->write(sink->ctx, &prefix, 1);
+		}
+		sink->write(sink->ctx, s, 3);
+		if (left_adjust) {
+			print_spaces(sink, (uint )pad_chars);
+		}
+
+		return;
+	}
+
+	fd.len = 0;
+	fd.exp = 0;
+	if (c == 'f') {
+		if (bits != 0) {
+			float_to_digits(bits, &fd, FLOAT_FRACTION, (int_fast16_t )precision);
+		}
+		e_style = false;
+		frac_len = precision;
+	} else if (c == 'e') {
+		if (bits != 0) {
+			float_to_digits(bits, &fd, FLOAT_SIGNIFICANT, (int_fast16_t )(precision + 1U));
 		}
+		e_style = true;
+		frac_len = precision;
 	} else {
-		pputc((uint_fast8_t )c);
+		if (SHORTEST_G && !opts->has_precision) {
+			if (bits != 0) {
+				float_to_digits(bits, &fd, FLOAT_SHORTEST, 0);
+			}
+			precision = (fd.len > 6U) ? fd.len : 6U;
+		} else {
+			if (precision == 0) {
+				precision = 1;
+			}
+			if (bits != 0) {
+				float_to_digits(bits, &fd, FLOAT_SIGNIFICANT, (int_fast16_t )precision);
+			}
+		}
+		e_style = ((fd.exp < -4) || (fd.exp >= (int_fast16_t )precision));
+		// Trailing zeros are dropped unless the alternate form is used.
+		len = (alt_form) ? precision : fd.len;
+		if (e_style) {
+			frac_len = (len > 1U) ? len - 1U : 0;
+		} else {
+			int_fast16_t frac = (int_fast16_t )len - (fd.exp + 1);
+
+			frac_len = (frac > 0) ? (uint_fast16_t )frac : 0;
+		}
+	}
+
+	if (e_style) {
+		uint_fast16_t exp = (fd.exp < 0) ? (uint_fast16_t )-fd.exp : (uint_fast16_t )fd.exp;
+
+		int_len = 1;
+		exp_buf[exp_len++] = (upper) ? 'E' : 'e';
+		exp_buf[exp_len++] = (fd.exp < 0) ? '-' : '+';
+		if (exp >= 100U) {
+			exp_buf[exp_len++] = (char )('0' + (exp / 100U));
+			exp %= 100U;
+		}
+		exp_buf[exp_len++] = (char )('0' + (exp / 10U));
+		exp_buf[exp_len++] = (char )('0' + (exp % 10U));
+	} else {
+		int_len = (fd.exp >= 0) ? (uint_fast16_t )(fd.exp + 1) : 1U;
+	}
+	point = ((frac_len > 0) || alt_form);
+
+	len = int_len + frac_len + exp_len + ((point) ? 1U : 0U) + ((prefix != 0) ? 1U : 0U);
+	pad_chars = (opts->width > len) ? opts->width - len : 0;
+
+	if (!left_adjust && !(ALLOW_ZERO_PADDING && opts->pad_0)) {
+		print_spaces(sink, (uint )pad_chars);
+	}
+	if (prefix != 0) {
+		sink->write(sink->ctx, &prefix, 1);
+	}
+	if (!left_adjust && (ALLOW_ZERO_PADDING && opts->pad_0)) {
+		print_digits(sink, &fd, -(int_fast16_t )pad_chars, pad_chars);
+	}
+
+	if (e_style || fd.exp >= 0) {
+		print_digits(sink, &fd, 0, int_len);
+	} else {
+		print_digits(sink, &fd, -1, 1);
+	}
+	if (point) {
+		sink->write(sink->ctx, ".", 1);
+	}
+	print_digits(sink, &fd, (int_fast16_t )((e_style) ? 1 : fd.exp + 1), frac_len);
+	if (exp_len > 0) {
+		sink->write(sink->ctx, exp_buf, exp_len);
+	}
+
+	if (left_adjust) {
+		print_spaces(sink, (uint )pad_chars);
 	}
 
-	//return MAX(1, opts->width);
 	return;
 }
+#endif // ALLOW_FLOATS
 
 __attribute__((weak))
 void ulib_vprintf(void(*pputc)(uint_fast8_t c), const char *restrict fmt_s, va_list arp) {
+	putc_sink_ctx_t ctx = { pputc };
+	printf_sink_t sink = { putc_sink_write, &ctx };
+
 	ulib_assert(pputc != NULL);
-	ulib_assert(fmt_s != NULL);
 
 	if (DO_PRINTF_SAFETY_CHECKS) {
-		if (pputc == NULL || fmt_s == NULL) {
-			//return -EINVAL;
+		if (pputc == NULL) {
 			return;
 		}
 	}
 
-	const uint8_t *fmt = (uint8_t *)fmt_s;
-	while (true) {
-		uint_fast8_t c;
-		for (c = *fmt++; c != '%' && c != 0; c = *fmt++) {
-			pputc(c);
-		}
-		if (c == 0) {
-			break;
-		}
-		c = *fmt++;
+	ulib_vprintf_sink(&sink, fmt_s, arp);
+
+	return;
+}
+
+// Split the next literal span and conversion off of fmt.
+// Returns a pointer to the rest of the format string or NULL if the end was
+// reached.
+static const uint8_t* parse_op(const uint8_t *fmt, printf_op_t *op) {
+	const uint8_t *literal = fmt;
+	uint_fast8_t c;
+
+	*op = (printf_op_t )OP_DEFAULT;
 
-		//
-		// Format specifiers take the form:
-		// %[flags][width][.precision][length modifier]conversion
-		//
-		printf_opts_t opts = OPTS_DEFAULT;
-
-		//
-		// Check for flags
-		//
-		bool done = false;
-		while (!done) {
-			switch (c) {
+	for (c = *fmt; c != '%' && c != 0; c = *++fmt) {
+		if ((fmt - literal) == UINT16_MAX) {
+			op->literal = (const char *)literal;
+			op->literal_len = UINT16_MAX;
+			return fmt;
+		}
+	}
+	op->literal = (const char *)literal;
+	op->literal_len = (uint16_t )(fmt - literal);
+	if (c == 0) {
+		return NULL;
+	}
+	++fmt;
+	c = *fmt++;
+
+	//
+	// Format specifiers take the form:
+	// %[flags][width][.precision][length modifier]conversion
+	//
+
+	//
+	// Check for flags
+	//
+	bool done = false;
+	while (!done) {
+		switch (c) {
 #if ALLOW_ZERO_PADDING || PARSE_IGNORED_FIELDS
-			case '0':
-				opts.pad_0 = true;
-				break;
+		case '0':
+			op->flags |= PRINTF_OP_FLAG_PAD_0;
+			break;
 #endif
 #if ALLOW_LEFT_ADJUST || PARSE_IGNORED_FIELDS
-			case '-':
-				opts.left_adjust = true;
-				break;
+		case '-':
+			op->flags |= PRINTF_OP_FLAG_LEFT_ADJUST;
+			break;
 #endif
 #if USE_POS_SIGN || PARSE_IGNORED_FIELDS
-			case ' ':
-				opts.pos_sign = POS_SIGN_BLANK;
-				break;
-			case '+':
-				opts.pos_sign = POS_SIGN_PLUS;
-				break;
+		case ' ':
+			op->flags |= PRINTF_OP_FLAG_POS_BLANK;
+			break;
+		case '+':
+			op->flags |= PRINTF_OP_FLAG_POS_PLUS;
+			break;
 #endif
 #if GROUP_1000s || PARSE_IGNORED_FIELDS
-			case '\'':
-				opts.group_1000s = true;
-				break;
+		case '\'':
+			op->flags |= PRINTF_OP_FLAG_GROUP_1000s;
+			break;
 #endif
 #if USE_ALT_FORM || PARSE_IGNORED_FIELDS
-			case '#':
-				opts.alt_form = true;
-				break;
+		case '#':
+			op->flags |= PRINTF_OP_FLAG_ALT_FORM;
+			break;
 #endif
-			default:
-				done = true;
-				break;
-			}
-			if (!done) {
-				c = *fmt++;
-			}
+		default:
+			done = true;
+			break;
+		}
+		if (!done) {
+			c = *fmt++;
 		}
+	}
 
-		//
-		// Check for width
-		//
+	//
+	// Check for width
+	//
 #if ALLOW_VARIABLE_WIDTH
-		if (c == '*') {
-			int w = va_arg(arp, int);
-
-			if (w < 0) {
-				w = -w;
-				opts.left_adjust = true;
-			}
-			opts.width = (uint_fast8_t )w;
-			c = *fmt++;
-		} else
+	if (c == '*') {
+		op->flags |= PRINTF_OP_FLAG_WIDTH_ARG;
+		c = *fmt++;
+	} else
 #endif
-		{
-			uint_fast8_t w = 0;
+	{
+		uint_fast8_t w = 0;
 
-			while (c >= '0' && c <= '9') {
-				w = (uint_fast8_t )(w * 10 + (c - '0'));
-				c = *fmt++;
-			}
-			opts.width = w;
+		while (c >= '0' && c <= '9') {
+			w = (uint_fast8_t )(w * 10 + (c - '0'));
+			c = *fmt++;
 		}
+		op->width = (uint8_t )w;
+	}
 
-		//
-		// Check for precision
-		// This is the only feature we remove when disabled because it's so much
-		// bigger and less common than everything else
+	//
+	// Check for precision
+	// This is the only feature we remove when disabled because it's so much
+	// bigger and less common than everything else
 #if USE_PRECISION
-		if (c == '.') {
+	if (c == '.') {
+		op->flags |= PRINTF_OP_FLAG_PRECISION;
+		c = *fmt++;
+# if ALLOW_VARIABLE_WIDTH || PARSE_IGNORED_FIELDS
+		if (c == '*') {
+			op->flags |= PRINTF_OP_FLAG_PRECISION_ARG;
 			c = *fmt++;
-# if ALLOW_VARIABLE_WIDTH
-			if (c == '*') {
-				int p = va_arg(arp, int);
-
-				if (p >= 0) {
-					opts.precision = (uint_fast8_t )p;
-				}
-				c = *fmt++;
-			} else
-# elif PARSE_IGNORED_FIELDS
-			if (c == '*') {
-				int p = va_arg(arp, int);
-				UNUSED(p);
-				c = *fmt++;
-			} else
+		} else
 # endif
-			{
-				uint_fast8_t p = 0;
+		{
+			uint_fast8_t p = 0;
 
-				while (c >= '0' && c <= '9') {
-					p = (uint_fast8_t )(p * 10 + (c - '0'));
-					c = *fmt++;
-				}
-				opts.precision = p;
+			while (c >= '0' && c <= '9') {
+				p = (uint_fast8_t )(p * 10 + (c - '0'));
+				c = *fmt++;
 			}
+			op->precision = (uint8_t )p;
 		}
+	}
 #elif PARSE_IGNORED_FIELDS
-		if (c == '.') {
+	if (c == '.') {
+		c = *fmt++;
+		if (c == '*') {
+			op->flags |= PRINTF_OP_FLAG_PRECISION_ARG;
 			c = *fmt++;
-			if (c == '*') {
-				int p = va_arg(arp, int);
-				UNUSED(p);
+		} else {
+			while (c >= '0' && c <= '9') {
 				c = *fmt++;
-			} else {
-				while (c >= '0' && c <= '9') {
-					c = *fmt++;
-				}
 			}
 		}
+	}
 #endif
 
-		//
-		// Check for length modifier
-		//
-		switch (c) {
+	//
+	// Check for length modifier
+	//
+	switch (c) {
 #if ALLOW_EXOTIC_TYPES || PARSE_IGNORED_FIELDS
-		case 'h':
-			if (*fmt == 'h') {
-				opts.int_size = sizeof(char);
-				fmt++;
-			} else {
-				opts.int_size = sizeof(short);
-			}
-			break;
-		case 'j':
-			opts.int_size = sizeof(intmax_t);
-			break;
-		case 'z':
-		//case 'Z':
-			opts.int_size = sizeof(size_t);
-			break;
-		case 't':
-			opts.int_size = sizeof(ptrdiff_t);
-			break;
-		case 'I':
-			if (*fmt == '8') {
-				++fmt;
-				opts.int_size = 1;
-			} else if (*fmt == '1' && fmt[1] == '6') {
-				fmt += 2;
-				opts.int_size = 2;
-			} else if (*fmt == '3' && fmt[1] == '2') {
-				fmt += 2;
-				opts.int_size = 4;
-			} else if (*fmt == '6' && fmt[1] == '4') {
-				fmt += 2;
-				opts.int_size = 8;
-			}
-			break;
+	case 'h':
+		if (*fmt == 'h') {
+			op->int_size = sizeof(char);
+			fmt++;
+		} else {
+			op->int_size = sizeof(short);
+		}
+		break;
+	case 'j':
+		op->int_size = sizeof(intmax_t);
+		break;
+	case 'z':
+	//case 'Z':
+		op->int_size = sizeof(size_t);
+		break;
+	case 't':
+		op->int_size = sizeof(ptrdiff_t);
+		break;
+	case 'I':
+		if (*fmt == '8') {
+			++fmt;
+			op->int_size = 1;
+		} else if (*fmt == '1' && fmt[1] == '6') {
+			fmt += 2;
+			op->int_size = 2;
+		} else if (*fmt == '3' && fmt[1] == '2') {
+			fmt += 2;
+			op->int_size = 4;
+		} else if (*fmt == '6' && fmt[1] == '4') {
+			fmt += 2;
+			op->int_size = 8;
+		}
+		break;
 #endif
-		case 'l':
-			if (*fmt == 'l') {
-				opts.int_size = sizeof(long long);
-				fmt++;
-			} else {
-				opts.int_size = sizeof(long);
-			}
-			break;
-#if PARSE_IGNORED_FIELDS
-		case 'L':
-			opts.int_size = sizeof(long double);
-			break;
+	case 'l':
+		if (*fmt == 'l') {
+			op->int_size = sizeof(long long);
+			fmt++;
+		} else {
+			op->int_size = sizeof(long);
+		}
+		break;
+#if PARSE_IGNORED_FIELDS || ALLOW_FLOATS
+	case 'L':
+		op->int_size = sizeof(long double);
+		break;
 #endif
+	}
+	if (op->int_size == 0) {
+		op->int_size = sizeof(int);
+	} else {
+		c = *fmt++;
+	}
+
+	op->conversion = (uint8_t )c;
+
+	return (c == 0) ? NULL : fmt;
+}
+
+// Print an op's literal span and then its conversion.
+// arp is a pointer so that the caller's argument list is advanced.
+static void run_op(const printf_sink_t *sink, const printf_op_t *op, va_list *arp) {
+	printf_opts_t opts = OPTS_DEFAULT;
+	uint_fast8_t c = op->conversion;
+	uint_fast16_t flags = op->flags;
+
+	if (op->literal_len > 0) {
+		sink->write(sink->ctx, op->literal, op->literal_len);
+	}
+	if (c == 0) {
+		return;
+	}
+
+	opts.width = op->width;
+	opts.precision = op->precision;
+	opts.int_size = op->int_size;
+	opts.pad_0 = ((flags & PRINTF_OP_FLAG_PAD_0) != 0);
+	opts.left_adjust = ((flags & PRINTF_OP_FLAG_LEFT_ADJUST) != 0);
+	opts.group_1000s = ((flags & PRINTF_OP_FLAG_GROUP_1000s) != 0);
+	opts.alt_form = ((flags & PRINTF_OP_FLAG_ALT_FORM) != 0);
+	opts.has_precision = (USE_PRECISION && ((flags & PRINTF_OP_FLAG_PRECISION) != 0));
+	if ((flags & PRINTF_OP_FLAG_POS_PLUS) != 0) {
+		opts.pos_sign = POS_SIGN_PLUS;
+	} else if ((flags & PRINTF_OP_FLAG_POS_BLANK) != 0) {
+		opts.pos_sign = POS_SIGN_BLANK;
+	}
+
+	if ((flags & PRINTF_OP_FLAG_WIDTH_ARG) != 0) {
+		int w = va_arg(*arp, int);
+
+		if (w < 0) {
+			w = -w;
+			opts.left_adjust = true;
 		}
-		if (opts.int_size == 0) {
-			opts.int_size = sizeof(int);
+		opts.width = (uint_fast8_t )w;
+	}
+	if ((flags & PRINTF_OP_FLAG_PRECISION_ARG) != 0) {
+		int p = va_arg(*arp, int);
+
+#if USE_PRECISION && ALLOW_VARIABLE_WIDTH
+		if (p >= 0) {
+			opts.precision = (uint_fast8_t )p;
 		} else {
-			c = *fmt++;
+			opts.has_precision = false;
 		}
+#else
+		UNUSED(p);
+#endif
+	}
 
-		//
-		// Finally, check for the conversion specifier
-		//
-		switch (c) {
-		case 0:
-			break;
-
-		case '%':
-			pputc('%');
-			break;
+	//
+	// Finally, check for the conversion specifier
+	//
+	switch (c) {
+	case '%':
+		sink->write(sink->ctx, "%", 1);
+		break;
 
 #if PRINT_BINARY || PARSE_IGNORED_FIELDS
-		case 'b':
-			opts.int_base = 2;
-			break;
+	case 'b':
+		opts.int_base = 2;
+		break;
+#endif
+	case 'c':
+		//pputc(va_arg(arp, unsigned char));
+		print_char(sink, (char )va_arg(*arp, int), &opts);
+		break;
+	case 'd':
+	case 'i':
+		opts.is_signed = true;
+		opts.int_base = 10;
+		break;
+	case 'o':
+		opts.int_base = 8;
+		break;
+	case 's':
+		print_string(sink, va_arg(*arp, const char *), &opts);
+		break;
+	case 'u':
+		opts.int_base = 10;
+		break;
+	case 'x':
+		opts.lower_hex = true;
+		opts.int_base = 16;
+		break;
+	case 'X':
+		opts.int_base = 16;
+		break;
+
+#if ALLOW_FLOATS
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G': {
+		double v;
+
+		if (opts.int_size == sizeof(long double)) {
+			v = (double )va_arg(*arp, long double);
+		} else {
+			v = va_arg(*arp, double);
+		}
+		print_float(sink, v, &opts, c);
+		break;
+	}
 #endif
-		case 'c':
-			//pputc(va_arg(arp, unsigned char));
-			print_char(pputc, (char )va_arg(arp, int), &opts);
-			break;
-		case 'd':
-		case 'i':
-			opts.is_signed = true;
-			opts.int_base = 10;
-			break;
-		case 'o':
-			opts.int_base = 8;
-			break;
-		case 's':
-			print_string(pputc, va_arg(arp, const char *), &opts);
-			break;
-		case 'u':
-			opts.int_base = 10;
-			break;
-		case 'x':
-			opts.lower_hex = true;
-			opts.int_base = 16;
-			break;
-		case 'X':
-			opts.int_base = 16;
-			break;
 
 #if PARSE_IGNORED_FIELDS
-		case 'n':
-		case 'e':
-		case 'E':
-		case 'f':
-		case 'F':
-		case 'g':
-		case 'G':
-		case 'a':
-		case 'A':
-		case 'p':
-		case 'm':
-		{
-			int tmp = va_arg(arp, int);
-			UNUSED(tmp);
-			break;
-		}
+	case 'n':
+# if !ALLOW_FLOATS
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+# endif
+	case 'a':
+	case 'A':
+	case 'p':
+	case 'm':
+	{
+		int tmp = va_arg(*arp, int);
+		UNUSED(tmp);
+		break;
+	}
 #endif
 
-		default:
-			pputc('%');
-			pputc(c);
-			break;
-		}
-		if (c == 0) {
-			break;
-		}
+	default: {
+		const char unknown[2] = { '%', (char )c };
 
-		if (opts.int_base > 0) {
-			printf_uint_t n = 0;
+		sink->write(sink->ctx, unknown, 2);
+		break;
+	}
+	}
+
+	if (opts.int_base > 0) {
+		printf_uint_t n = 0;
 
-			// The integer arguments to a variadic function are promoted if smaller
-			// than int so we need to read them as ints.
-			if (opts.is_signed) {
-				switch (opts.int_size) {
-				case 1:
+		// The integer arguments to a variadic function are promoted if smaller
+		// than int so we need to read them as ints.
+		if (opts.is_signed) {
+			switch (opts.int_size) {
+			case 1:
 #if TRY_LARGE_INTS || PRINTF_MAX_INT_BYTES >= 2
-				case 2:
+			case 2:
 #endif
-					GET_SIGNED_INT_ARG(n, int, UINT_MAX);
-					break;
+				GET_SIGNED_INT_ARG(n, int, UINT_MAX);
+				break;
 #if TRY_LARGE_INTS || PRINTF_MAX_INT_BYTES >= 4
-				case 4:
-					GET_SIGNED_INT_ARG(n, int32_t, UINT32_MAX);
-					break;
+			case 4:
+				GET_SIGNED_INT_ARG(n, int32_t, UINT32_MAX);
+				break;
 #endif
 #if TRY_LARGE_INTS || PRINTF_MAX_INT_BYTES >= 8
-				case 8:
-					GET_SIGNED_INT_ARG(n, int64_t, UINT64_MAX);
-					break;
+			case 8:
+				GET_SIGNED_INT_ARG(n, int64_t, UINT64_MAX);
+				break;
 #endif
-				}
-			} else {
-				switch (opts.int_size) {
-				case 1:
-					GET_UNSIGNED_INT_ARG(n, uint8_t, int);
-					break;
+			}
+		} else {
+			switch (opts.int_size) {
+			case 1:
+				GET_UNSIGNED_INT_ARG(n, uint8_t, int);
+				break;
 #if TRY_LARGE_INTS || PRINTF_MAX_INT_BYTES >= 2
-				case 2:
+			case 2:
 #endif
-					GET_UNSIGNED_INT_ARG(n, uint16_t, int);
-					break;
+				GET_UNSIGNED_INT_ARG(n, uint16_t, int);
+				break;
 #if TRY_LARGE_INTS || PRINTF_MAX_INT_BYTES >= 4
-				case 4:
-					GET_UNSIGNED_INT_ARG(n, uint32_t, uint32_t);
-					break;
+			case 4:
+				GET_UNSIGNED_INT_ARG(n, uint32_t, uint32_t);
+				break;
 #endif
 #if TRY_LARGE_INTS || PRINTF_MAX_INT_BYTES >= 8
-				case 8:
-					GET_UNSIGNED_INT_ARG(n, uint64_t, uint64_t);
-					break;
+			case 8:
+				GET_UNSIGNED_INT_ARG(n, uint64_t, uint64_t);
+				break;
 #endif
-				}
 			}
+		}
+
+		//char_count += print_int(sink, n, opts);
+		print_int(sink, n, &opts);
+	}
+
+	return;
+}
+
+__attribute__((weak))
+void ulib_vprintf_sink(const printf_sink_t *sink, const char *restrict fmt_s, va_list arp) {
+	va_list ap;
+
+	ulib_assert(sink != NULL);
+	ulib_assert(fmt_s != NULL);
 
-			//char_count += print_int(pputc, n, opts);
-			print_int(pputc, n, &opts);
+	if (DO_PRINTF_SAFETY_CHECKS) {
+		if (sink == NULL || sink->write == NULL || fmt_s == NULL) {
+			//return -EINVAL;
+			return;
 		}
 	}
 
+	// va_list may be an array type, in which case a pointer to the parameter
+	// isn't a pointer to a va_list; a copy is needed to pass it around.
+	va_copy(ap, arp);
+	for (const uint8_t *fmt = (const uint8_t *)fmt_s; fmt != NULL;) {
+		printf_op_t op;
+
+		fmt = parse_op(fmt, &op);
+		run_op(sink, &op, &ap);
+	}
+	va_end(ap);
+
+	return;
+}
+
+uint_t ulib_printf_compile(printf_op_t *ops, uint_t max_ops, const char *restrict fmt_s) {
+	uint_t count = 0;
+
+	ulib_assert((ops != NULL) || (max_ops == 0));
+	ulib_assert(fmt_s != NULL);
+
+	if (DO_PRINTF_SAFETY_CHECKS) {
+		if (fmt_s == NULL) {
+			return 0;
+		}
+		if (ops == NULL) {
+			max_ops = 0;
+		}
+	}
+
+	for (const uint8_t *fmt = (const uint8_t *)fmt_s; fmt != NULL;) {
+		printf_op_t op;
+
+		fmt = parse_op(fmt, &op);
+		// Don't bother with the empty op at the end of a format string that
+		// ends with a conversion.
+		if ((op.literal_len == 0) && (op.conversion == 0)) {
+			continue;
+		}
+		if (count < max_ops) {
+			ops[count] = op;
+		}
+		++count;
+	}
+
+	return count;
+}
+void ulib_printf_compiled(const printf_sink_t *sink, const printf_op_t *ops, uint_t op_count, ...) {
+	va_list arp;
+
+	va_start(arp, op_count);
+	ulib_vprintf_compiled(sink, ops, op_count, arp);
+	va_end(arp);
+
+	return;
+}
+void ulib_vprintf_compiled(const printf_sink_t *sink, const printf_op_t *ops, uint_t op_count, va_list arp) {
+	va_list ap;
+
+	ulib_assert(sink != NULL);
+	ulib_assert((ops != NULL) || (op_count == 0));
+
+	if (DO_PRINTF_SAFETY_CHECKS) {
+		if (sink == NULL || sink->write == NULL || ops == NULL) {
+			return;
+		}
+	}
+
+	va_copy(ap, arp);
+	for (uint_t i = 0; i < op_count; ++i) {
+		run_op(sink, &ops[i], &ap);
+	}
+	va_end(ap);
+
 	return;
 }
 
@@ -0,0 +1,429 @@
+// SPDX-License-Identifier: GPL-3.0-only
+/***********************************************************************
+*                                                                      *
+*                                                                      *
+* Copyright 2024 svijsv                                                *
+* This program is free software: you can redistribute it and/or modify *
+* it under the terms of the GNU General Public License as published by *
+* the Free Software Foundation, version 3.                             *
+*                                                                      *
+* This program is distributed in the hope that it will be useful, but  *
+* WITHOUT ANY WARRANTY; without even the implied warranty of           *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU    *
+* General Public License for more details.                             *
+*                                                                      *
+* You should have received a copy of the GNU General Public License    *
+* along with this program. If not, see <http:// www.gnu.org/licenses/>.*
+*                                                                      *
+*                                                                      *
+***********************************************************************/
+// rope.c
+// Build up large strings in pieces without ever re-allocating them
+//
+// NOTES:
+//   A span that ends where the next one starts is extended rather than
+//   adding a new one, so consecutive small copies into the same block (or
+//   borrowed pieces of one buffer) cost a single span.
+//
+//   The span array is the only thing that's ever re-allocated, and it holds
+//   pointers rather than text.
+//
+//
+#include "rope.h"
+#if ULIB_ENABLE_ROPE
+
+#include "debug.h"
+#include "printf.h"
+#include "strings.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+#if ROPE_USE_IOVEC
+# include <errno.h>
+# include <sys/uio.h>
+#endif
+
+
+#if ! ULIB_USE_MALLOC
+# error "The ROPE module requires ULIB_USE_MALLOC"
+#endif
+#if ROPE_BLOCK_BYTES < 64
+# error "ROPE_BLOCK_BYTES < 64"
+#endif
+#if ROPE_USE_IOVEC && ROPE_IOVEC_BATCH < 1
+# error "ROPE_IOVEC_BATCH < 1"
+#endif
+
+// The number of spans allocated the first time one is needed.
+#define MIN_SPANS 16U
+
+typedef struct rope_block_t {
+	struct rope_block_t *next;
+	size_t size;
+	size_t used;
+	char data[];
+} rope_block_t;
+
+#define ASSERT_ROPE(r) ulib_assert(POINTER_IS_VALID(r))
+#define ASSERT_BUF(b, l) ulib_assert(POINTER_IS_VALID(b) || ((l) == 0))
+
+
+// Add a span to the end of a rope, extending the last one if they touch.
+static bool add_span(rope_t *r, const char *ptr, size_t len) {
+	rope_span_t *last;
+
+	if (r->span_count > 0) {
+		last = &r->spans[r->span_count-1U];
+		if ((last->ptr + last->length) == ptr) {
+			last->length += len;
+			r->length += len;
+			return true;
+		}
+	}
+	if (r->span_count == r->spans_allocated) {
+		size_t new_count = (r->spans_allocated > 0) ? (r->spans_allocated * 2U) : MIN_SPANS;
+		rope_span_t *tmp;
+
+		if ((new_count < r->spans_allocated) || (new_count > (SIZE_MAX / sizeof(*tmp)))) {
+			return false;
+		}
+		if ((tmp = realloc(r->spans, new_count * sizeof(*tmp))) == NULL) {
+			return false;
+		}
+		r->spans = tmp;
+		r->spans_allocated = new_count;
+	}
+
+	last = &r->spans[r->span_count];
+	last->ptr = ptr;
+	last->length = len;
+	++r->span_count;
+	r->length += len;
+
+	return true;
+}
+// Add a block big enough for at least want bytes.
+static rope_block_t* add_block(rope_t *r, size_t want) {
+	rope_block_t *b;
+	size_t size = ROPE_BLOCK_BYTES - sizeof(*b);
+
+	if (want > size) {
+		if (want > (SIZE_MAX - sizeof(*b))) {
+			return NULL;
+		}
+		size = want;
+	}
+	if ((b = malloc(sizeof(*b) + size)) == NULL) {
+		return NULL;
+	}
+	b->size = size;
+	b->used = 0;
+	b->next = r->blocks;
+	r->blocks = b;
+
+	return b;
+}
+static void append_copy(rope_t *r, const char *buf, size_t len) {
+	while (len > 0) {
+		rope_block_t *b = r->blocks;
+		size_t n;
+
+		if ((b == NULL) || (b->used == b->size)) {
+			if ((b = add_block(r, len)) == NULL) {
+				r->truncated = true;
+				return;
+			}
+		}
+		n = MIN(len, b->size - b->used);
+		if (!add_span(r, &b->data[b->used], n)) {
+			r->truncated = true;
+			return;
+		}
+		memcpy(&b->data[b->used], buf, n);
+		b->used += n;
+		buf += n;
+		len -= n;
+	}
+
+	return;
+}
+
+
+rope_t* rope_init(rope_t *r) {
+	ASSERT_ROPE(r);
+
+#if DO_ROPE_SAFETY_CHECKS
+	if (r == NULL) {
+		return NULL;
+	}
+#endif
+
+	mem_init(r, 0, sizeof(*r));
+
+	return r;
+}
+rope_t* rope_clear(rope_t *r) {
+	rope_block_t *b;
+
+	ASSERT_ROPE(r);
+
+#if DO_ROPE_SAFETY_CHECKS
+	if (r == NULL) {
+		return NULL;
+	}
+#endif
+
+	while ((b = r->blocks) != NULL) {
+		r->blocks = b->next;
+		free(b);
+	}
+	free(r->spans);
+
+	return rope_init(r);
+}
+
+rope_t* rope_append(rope_t *r, const void *buf, size_t len) {
+	ASSERT_ROPE(r);
+	ASSERT_BUF(buf, len);
+
+#if DO_ROPE_SAFETY_CHECKS
+	if (r == NULL) {
+		return NULL;
+	}
+	if (buf == NULL) {
+		return r;
+	}
+#endif
+
+	append_copy(r, buf, len);
+
+	return r;
+}
+rope_t* rope_append_cstring(rope_t *r, const char *c, size_t len) {
+	ASSERT_ROPE(r);
+	ulib_assert(POINTER_IS_VALID(c));
+
+#if DO_ROPE_SAFETY_CHECKS
+	if (r == NULL) {
+		return NULL;
+	}
+	if (c == NULL) {
+		return r;
+	}
+#endif
+
+	if (len == 0) {
+		len = strlen(c);
+	}
+	append_copy(r, c, len);
+
+	return r;
+}
+rope_t* rope_append_string(rope_t *r, const string_t *s) {
+	ulib_assert(POINTER_IS_VALID(s));
+
+#if DO_ROPE_SAFETY_CHECKS
+	if (s == NULL) {
+		return r;
+	}
+#endif
+
+	return rope_append(r, s->cstring, s->length);
+}
+rope_t* rope_append_strview(rope_t *r, strview_t v) {
+	return rope_append(r, v.ptr, v.length);
+}
+rope_t* rope_append_borrowed(rope_t *r, const void *buf, size_t len) {
+	ASSERT_ROPE(r);
+	ASSERT_BUF(buf, len);
+
+#if DO_ROPE_SAFETY_CHECKS
+	if (r == NULL) {
+		return NULL;
+	}
+	if (buf == NULL) {
+		return r;
+	}
+#endif
+
+	if ((len > 0) && !add_span(r, buf, len)) {
+		r->truncated = true;
+	}
+
+	return r;
+}
+
+#if ULIB_ENABLE_PRINTF
+static void rope_sink_write(void *ctx, const char *buf, size_t len) {
+	append_copy(ctx, buf, len);
+	return;
+}
+rope_t* rope_appendf_va(rope_t *restrict r, const char *restrict format, va_list arp) {
+	printf_sink_t sink;
+
+	ASSERT_ROPE(r);
+	ulib_assert(POINTER_IS_VALID(format));
+
+#if DO_ROPE_SAFETY_CHECKS
+	if (r == NULL) {
+		return NULL;
+	}
+	if (format == NULL) {
+		return r;
+	}
+#endif
+
+	sink.write = rope_sink_write;
+	sink.ctx = r;
+	ulib_vprintf_sink(&sink, format, arp);
+
+	return r;
+}
+rope_t* rope_appendf(rope_t *restrict r, const char *restrict format, ...) {
+	va_list arp;
+
+	va_start(arp, format);
+	rope_appendf_va(r, format, arp);
+	va_end(arp);
+
+	return r;
+}
+#endif // ULIB_ENABLE_PRINTF
+
+string_t* rope_flatten(const rope_t *r, string_t *s) {
+	ASSERT_ROPE(r);
+	ulib_assert(POINTER_IS_VALID(s));
+
+#if DO_ROPE_SAFETY_CHECKS
+	if ((r == NULL) || (s == NULL)) {
+		return s;
+	}
+#endif
+
+	string_reserve(string_clear(s), (strlen_t )MIN(r->length, STRING_MAX_BYTES));
+	for (size_t i = 0; (i < r->span_count) && (s->length < STRING_MAX_BYTES); ++i) {
+		strview_t v;
+
+		v.ptr = r->spans[i].ptr;
+		v.length = (strlen_t )MIN(r->spans[i].length, STRING_MAX_BYTES);
+		string_append_from_strview(s, v);
+	}
+
+	return s;
+}
+size_t rope_copy(const rope_t *r, size_t offset, void *buf, size_t size) {
+	char *cbuf = buf;
+	size_t copied = 0;
+
+	ASSERT_ROPE(r);
+	ASSERT_BUF(buf, size);
+
+#if DO_ROPE_SAFETY_CHECKS
+	if ((r == NULL) || (buf == NULL)) {
+		return 0;
+	}
+#endif
+
+	for (size_t i = 0; (i < r->span_count) && (copied < size); ++i) {
+		const rope_span_t *span = &r->spans[i];
+		size_t n;
+
+		if (offset >= span->length) {
+			offset -= span->length;
+			continue;
+		}
+		n = MIN(span->length - offset, size - copied);
+		memcpy(&cbuf[copied], &span->ptr[offset], n);
+		copied += n;
+		offset = 0;
+	}
+
+	return copied;
+}
+
+#if ROPE_USE_IOVEC
+size_t rope_get_iovec(const rope_t *r, size_t first_span, struct iovec *ret_iov, size_t max_iov) {
+	size_t n = 0;
+
+	ASSERT_ROPE(r);
+	ulib_assert(POINTER_IS_VALID(ret_iov) || (max_iov == 0));
+
+#if DO_ROPE_SAFETY_CHECKS
+	if ((r == NULL) || (ret_iov == NULL)) {
+		return 0;
+	}
+#endif
+
+	for (size_t i = first_span; (i < r->span_count) && (n < max_iov); ++i, ++n) {
+		// iov_base isn't const-qualified, but writev() only reads from it.
+		ret_iov[n].iov_base = (void *)r->spans[i].ptr;
+		ret_iov[n].iov_len = r->spans[i].length;
+	}
+
+	return n;
+}
+size_t rope_write_fd(const rope_t *r, int fd) {
+	struct iovec iov[ROPE_IOVEC_BATCH];
+	size_t next_span = 0, total = 0;
+	size_t first = 0, count = 0;
+
+	ASSERT_ROPE(r);
+	ulib_assert(fd >= 0);
+
+#if DO_ROPE_SAFETY_CHECKS
+	if (r == NULL) {
+		return 0;
+	}
+	if (fd < 0) {
+		errno = EBADF;
+		return 0;
+	}
+#endif
+
+	while (true) {
+		ssize_t bytes;
+
+		if (first == count) {
+			if ((count = rope_get_iovec(r, next_span, iov, ROPE_IOVEC_BATCH)) == 0) {
+				break;
+			}
+			next_span += count;
+			first = 0;
+		}
+
+		bytes = writev(fd, &iov[first], (int )(count - first));
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		} else if (bytes == 0) {
+			// Spans are never empty, so this shouldn't happen.
+			errno = EIO;
+			break;
+		}
+		total += (size_t )bytes;
+
+		// Skip past whatever was written, which may end part way into
+		// an entry.
+		for (size_t n = (size_t )bytes; n > 0;) {
+			if (n >= iov[first].iov_len) {
+				n -= iov[first].iov_len;
+				++first;
+			} else {
+				iov[first].iov_base = (char *)iov[first].iov_base + n;
+				iov[first].iov_len -= n;
+				n = 0;
+			}
+		}
+	}
+
+	return total;
+}
+#endif // ROPE_USE_IOVEC
+
+#else
+	// ISO C forbids empty translation units, this makes it happy.
+	typedef int make_iso_compilers_happy;
+#endif // ULIB_ENABLE_ROPE
@@ -35,6 +35,7 @@
 #include "printf.h"
 #include "util.h"
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -43,6 +44,47 @@
 # include <stdio.h>
 #endif
 
+
+#if STRING_ALLOC_BLOCK_BYTES < 1
+# error "STRING_ALLOC_BLOCK_BYTES < 1"
+#endif
+#if STRING_GROW_FACTOR < 1
+# error "STRING_GROW_FACTOR < 1"
+#endif
+#if (STRING_GROW_METHOD == STRING_GROW_MUL) && (STRING_GROW_FACTOR <= 1)
+# error "(STRING_GROW_METHOD == STRING_GROW_MUL) && (STRING_GROW_FACTOR <= 1)"
+#endif
+
+#if STRING_SMALL_BYTES > (STRING_MAX_BYTES + 1U)
+# error "STRING_SMALL_BYTES > (STRING_MAX_BYTES + 1U)"
+#endif
+#if STRINGS_USE_ARENAS && ! STRINGS_USE_MALLOC
+# error "STRINGS_USE_ARENAS requires STRINGS_USE_MALLOC"
+#endif
+#if STRINGS_USE_SHARING && ! STRINGS_USE_MALLOC
+# error "STRINGS_USE_SHARING requires STRINGS_USE_MALLOC"
+#endif
+
+// The most space a string can use, including the trailing NUL.
+#define STRING_MAX_ALLOCATED ((strlen_t )(STRING_MAX_BYTES + 1U))
+
+// Check whether a string's contents are held in its internal buffer.
+#if STRINGS_USE_MALLOC && STRING_SMALL_BYTES > 0
+# define IS_SMALL_STRING(s) ((s)->cstring == (s)->small)
+#else
+# define IS_SMALL_STRING(s) (false)
+#endif
+
+// Alignment of string_t structures allocated from an arena.
+#define ARENA_ALIGNMENT (MAX(sizeof(uintptr_t), sizeof(strlen_t)))
+
+// Forget a string's cached hash after its contents change.
+#if STRINGS_CACHE_HASH
+# define INVALIDATE_HASH(s) ((s)->hash = 0U)
+#else
+# define INVALIDATE_HASH(s) ((void )0U)
+#endif
+
 // Determine the combined length of two strings taking STRING_MAX_BYTES into account
 //#define COMBINED_LENGTH(a, b) (((STRING_MAX_BYTES - (a)) > (b)) ? STRING_MAX_BYTES : ((a) + (b)))
 //#define COMBINED_LENGTH(a, b) CLIP_UADD(a, b, STRING_MAX_BYTES)
@@ -82,12 +124,6 @@ INLINE strlen_t COMBINED_LENGTH(strlen_t a, strlen_t b) {
 //#define ASSERT_ARP(a) ulib_assert(POINTER_IS_VALID(a))
 #define ASSERT_ARP(a) ((void )0U)
 
-// A pointer set by string_appendf_va and used by the non-reentrant string_putc()
-// function so that it can have the same signature as putc().
-#if STRINGS_USE_INTERNAL_PRINTF
-static string_t *S_printf_string;
-#endif
-
 // Make sure the value returned by strlen() is <= STRING_MAX_BYTES
 INLINE strlen_t strlen_checked(const char *c) {
 	size_t n = strlen(c);
@@ -96,29 +132,264 @@ INLINE strlen_t strlen_checked(const char *c) {
 
 
 /*
-* Initialization functions
+* Buffer management
+* Everything that gets memory for a string's contents goes through these so
+* that arena-bound strings are handled the same way as others.
 */
-string_t* string_init(string_t *s) {
-	ulib_assert(s != NULL);
+#if STRINGS_USE_ARENAS
+static bool arena_owns(const string_arena_t *a, const void *ptr) {
+	const char *p = ptr;
 
-#if DO_STRING_SAFETY_CHECKS
-	if (s == NULL) {
+	return ((p >= a->base) && (p < (a->base + a->size)));
+}
+static void* arena_alloc(string_arena_t *a, size_t size, size_t align) {
+	size_t start = a->used;
+	size_t rem = (size_t )((uintptr_t )(a->base + start) % align);
+
+	if (rem != 0) {
+		start += align - rem;
+	}
+	if ((start > a->size) || (size > (a->size - start))) {
 		return NULL;
 	}
+	a->last = a->base + start;
+	a->used = start + size;
+
+	return a->last;
+}
+#endif // STRINGS_USE_ARENAS
+
+#if STRINGS_USE_SHARING
+// Buffers allocated with malloc() are preceded by the number of strings
+// using them.
+typedef struct {
+	uint32_t refs;
+} share_header_t;
+
+static share_header_t* share_header(char *cstring) {
+	return (share_header_t *)(void *)(cstring - sizeof(share_header_t));
+}
+# if STRINGS_SHARE_ATOMIC
+static uint32_t get_refs(share_header_t *h) {
+	return __atomic_load_n(&h->refs, __ATOMIC_ACQUIRE);
+}
+static void add_ref(share_header_t *h) {
+	__atomic_add_fetch(&h->refs, 1U, __ATOMIC_RELAXED);
+	return;
+}
+static uint32_t drop_ref(share_header_t *h) {
+	return __atomic_sub_fetch(&h->refs, 1U, __ATOMIC_ACQ_REL);
+}
+# else
+static uint32_t get_refs(share_header_t *h) {
+	return h->refs;
+}
+static void add_ref(share_header_t *h) {
+	++h->refs;
+	return;
+}
+static uint32_t drop_ref(share_header_t *h) {
+	return --h->refs;
+}
+# endif
+// Check whether a string's buffer has a share_header_t.
+static bool is_shareable(const string_t *s) {
+# if STRINGS_USE_ARENAS
+	if (s->arena != NULL) {
+		return false;
+	}
+# endif
+	return (!IS_SMALL_STRING(s) && (s->cstring != NULL));
+}
+static bool is_shared(const string_t *s) {
+	return (is_shareable(s) && (get_refs(share_header(s->cstring)) > 1U));
+}
+#endif // STRINGS_USE_SHARING
+
+#if STRINGS_USE_MALLOC
+static char* alloc_buffer(string_t *s, strlen_t size) {
+# if STRINGS_USE_ARENAS
+	if (s->arena != NULL) {
+		return arena_alloc(s->arena, size, 1U);
+	}
+# endif
+
+# if STRINGS_USE_SHARING
+	{
+		share_header_t *h;
+
+		// Only possible when strlen_t is as wide as size_t.
+#  if STRING_MAX_BYTES > (SIZE_MAX - 16U)
+		if (size > (SIZE_MAX - sizeof(*h))) {
+			return NULL;
+		}
+#  endif
+		if ((h = malloc(sizeof(*h) + (size * sizeof(*s->cstring)))) == NULL) {
+			return NULL;
+		}
+		h->refs = 1U;
+
+		return (char *)(void *)(h + 1);
+	}
+# else
+	return malloc(size * sizeof(*s->cstring));
+# endif
+}
+static void release_buffer(string_t *s);
+static char* resize_buffer(string_t *s, strlen_t size) {
+# if STRINGS_USE_ARENAS
+	string_arena_t *a = s->arena;
+
+	if (a != NULL) {
+		char *tmp;
+
+		if ((s->cstring != NULL) && (a->last == s->cstring)) {
+			size_t start = (size_t )(s->cstring - a->base);
+
+			if (size > (a->size - start)) {
+				return NULL;
+			}
+			a->used = start + size;
+
+			return s->cstring;
+		}
+		// Shrinking anything else gains nothing.
+		if ((s->cstring != NULL) && (size <= s->allocated)) {
+			return s->cstring;
+		}
+		if ((tmp = arena_alloc(a, size, 1U)) != NULL && (s->cstring != NULL)) {
+			memcpy(tmp, s->cstring, s->allocated);
+		}
+
+		return tmp;
+	}
+# endif
+
+# if STRINGS_USE_SHARING
+	if (s->cstring == NULL) {
+		return alloc_buffer(s, size);
+	} else {
+		share_header_t *h = share_header(s->cstring);
+
+		// Other strings are still using the old buffer, so make a new one.
+		if (get_refs(h) > 1U) {
+			char *tmp;
+
+			if ((tmp = alloc_buffer(s, size)) != NULL) {
+				memcpy(tmp, s->cstring, MIN(size, s->allocated));
+				release_buffer(s);
+			}
+
+			return tmp;
+		}
+#  if STRING_MAX_BYTES > (SIZE_MAX - 16U)
+		if (size > (SIZE_MAX - sizeof(*h))) {
+			return NULL;
+		}
+#  endif
+		if ((h = realloc(h, sizeof(*h) + (size * sizeof(*s->cstring)))) == NULL) {
+			return NULL;
+		}
+
+		return (char *)(void *)(h + 1);
+	}
+# else
+	return realloc(s->cstring, size * sizeof(*s->cstring));
+# endif
+}
+static void release_buffer(string_t *s) {
+# if STRINGS_USE_ARENAS
+	string_arena_t *a = s->arena;
+
+	if (a != NULL) {
+		// Only the most recent allocation can be given back.
+		if ((s->cstring != NULL) && (a->last == s->cstring)) {
+			a->used = (size_t )(s->cstring - a->base);
+			a->last = NULL;
+		}
+		return;
+	}
+# endif
+
+# if STRINGS_USE_SHARING
+	if ((s->cstring != NULL) && (drop_ref(share_header(s->cstring)) == 0U)) {
+		free(share_header(s->cstring));
+	}
+# else
+	free(s->cstring);
+# endif
+	return;
+}
+#endif // STRINGS_USE_MALLOC
+
+// Prepare a string for its contents to be changed, giving it its own copy
+// of a shared buffer.
+// Returns false if that isn't possible, in which case the string must be
+// left unchanged.
+static bool begin_modify(string_t *s) {
+#if STRINGS_USE_SHARING
+	if (is_shared(s)) {
+		char *tmp;
+
+		if ((tmp = alloc_buffer(s, s->allocated)) == NULL) {
+			return false;
+		}
+		memcpy(tmp, s->cstring, s->length + 1U);
+		release_buffer(s);
+		s->cstring = tmp;
+	}
+#endif
+#if !STRINGS_USE_SHARING && !STRINGS_CACHE_HASH
+	UNUSED(s);
 #endif
+	INVALIDATE_HASH(s);
 
+	return true;
+}
+
+
+/*
+* Initialization functions
+*/
+// Set up the contents of a string whose other fields have been set.
+// Returns NULL if the buffer couldn't be allocated.
+static string_t* init_contents(string_t *s) {
 #if ULIB_USE_STRUCT_ID
 	s->id.value = ID_STRING;
 #endif
+	s->length = 0;
+	INVALIDATE_HASH(s);
 #if STRINGS_USE_MALLOC
+# if STRING_SMALL_BYTES > 0
+	s->allocated = STRING_SMALL_BYTES;
+	s->cstring = s->small;
+# else
 	s->allocated = STRING_ALLOC_BLOCK_BYTES;
-	s->cstring = malloc(s->allocated);
+	if ((s->cstring = alloc_buffer(s, s->allocated)) == NULL) {
+		s->allocated = 0;
+		return NULL;
+	}
+# endif
 #endif
 	s->cstring[0] = 0;
-	s->length = 0;
 
 	return s;
 }
+string_t* string_init(string_t *s) {
+	ulib_assert(s != NULL);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (s == NULL) {
+		return NULL;
+	}
+#endif
+
+#if STRINGS_USE_ARENAS
+	s->arena = NULL;
+#endif
+
+	return init_contents(s);
+}
 string_t* string_clear(string_t *s) {
 	ASSERT_STRING(s);
 
@@ -135,16 +406,33 @@ string_t* string_clear(string_t *s) {
 # endif
 #endif
 
+#if STRINGS_USE_SHARING
+	// There's no need to copy a shared buffer just to empty it.
+	if (is_shared(s)) {
+		release_buffer(s);
+		return init_contents(s);
+	}
+#endif
+
 	s->length = 0;
 	s->cstring[0] = 0;
+	INVALIDATE_HASH(s);
 
 	return s;
 }
 #if STRINGS_USE_MALLOC
 string_t* string_new() {
-	string_t *s = malloc(sizeof(*s));
+	string_t *s;
+
+	if ((s = malloc(sizeof(*s))) == NULL) {
+		return NULL;
+	}
+	if (string_init(s) == NULL) {
+		free(s);
+		return NULL;
+	}
 
-	return string_init(s);
+	return s;
 }
 string_t* string_new_from_string(const string_t *s) {
 	string_t *d;
@@ -157,15 +445,21 @@ string_t* string_new_from_string(const string_t *s) {
 	}
 #endif
 
-	d = malloc(sizeof(*d));
-	//d->allocated = SNAP_TO_NEXT_FACTOR(s->length+1, STRING_ALLOC_BLOCK_BYTES);
-	d->allocated = s->length+1;
-	d->length = s->length;
-	d->cstring = malloc(d->allocated);
-	memcpy(d->cstring, s->cstring, s->length);
-	d->cstring[s->length] = 0;
+	if ((d = string_new()) == NULL) {
+		return NULL;
+	}
+
+#if STRINGS_USE_SHARING
+	return string_share(d, s);
+#else
+	string_reserve(d, s->length);
+	// The reservation may have failed.
+	d->length = MIN(s->length, (strlen_t )(d->allocated - 1U));
+	memcpy(d->cstring, s->cstring, d->length);
+	d->cstring[d->length] = 0;
 
 	return d;
+#endif
 }
 string_t* string_new_from_cstring(const char *c, strlen_t len) {
 	string_t *s;
@@ -186,13 +480,14 @@ string_t* string_new_from_cstring(const char *c, strlen_t len) {
 		return string_new();
 	}
 
-	s = malloc(sizeof(*s));
-	//s->allocated = SNAP_TO_NEXT_FACTOR(len+1, STRING_ALLOC_BLOCK_BYTES);
-	s->allocated = len+1;
-	s->length = len;
-	s->cstring = malloc(s->allocated);
-	memcpy(s->cstring, c, len);
-	s->cstring[len] = 0;
+	if ((s = string_new()) == NULL) {
+		return NULL;
+	}
+	string_reserve(s, len);
+	// The reservation may have failed.
+	s->length = MIN(len, (strlen_t )(s->allocated - 1U));
+	memcpy(s->cstring, c, s->length);
+	s->cstring[s->length] = 0;
 
 	return s;
 }
@@ -225,9 +520,14 @@ string_t* _string_free(string_t *s) {
 	// true.
 	//if (POINTER_IS_VALID(s) && IS_STRING_ID(s)) {
 	if (IS_STRING_ID(s)) {
-		if (POINTER_IS_VALID(s->cstring) && (s->allocated > 0)) {
-			free(s->cstring);
+		if (POINTER_IS_VALID(s->cstring) && (s->allocated > 0) && !IS_SMALL_STRING(s)) {
+			release_buffer(s);
 		}
+#if STRINGS_USE_ARENAS
+		if ((s->arena != NULL) && arena_owns(s->arena, s)) {
+			return NULL;
+		}
+#endif
 		free(s);
 	}
 
@@ -240,6 +540,184 @@ void string_free_void(void *ptr) {
 #endif // STRINGS_USE_MALLOC
 
 
+/*
+* Allocation functions
+*/
+#if STRINGS_USE_MALLOC
+// Re-allocate a string's buffer to hold exactly size bytes, moving it into
+// or out of the internal buffer as needed.
+static bool set_allocated(string_t *s, strlen_t size) {
+	char *tmp;
+
+#if STRING_SMALL_BYTES > 0
+	if (size <= STRING_SMALL_BYTES) {
+		if (!IS_SMALL_STRING(s)) {
+			memcpy(s->small, s->cstring, s->length + 1U);
+			release_buffer(s);
+			s->cstring = s->small;
+		}
+		s->allocated = STRING_SMALL_BYTES;
+
+		return true;
+	}
+	if (IS_SMALL_STRING(s)) {
+		if ((tmp = alloc_buffer(s, size)) == NULL) {
+			return false;
+		}
+		memcpy(tmp, s->small, s->length + 1U);
+		s->cstring = tmp;
+		s->allocated = size;
+
+		return true;
+	}
+#endif
+
+	if ((tmp = resize_buffer(s, size)) == NULL) {
+		return false;
+	}
+	s->cstring = tmp;
+	s->allocated = size;
+
+	return true;
+}
+// Round an allocation size up to a multiple of STRING_ALLOC_BLOCK_BYTES.
+static strlen_t snap_allocated(strlen_t size) {
+	strlen_t rem = (strlen_t )(size % STRING_ALLOC_BLOCK_BYTES);
+
+	if (rem != 0) {
+		size = (strlen_t )CLIP_UADD(size, (strlen_t )(STRING_ALLOC_BLOCK_BYTES - rem), STRING_MAX_ALLOCATED);
+	}
+
+	return size;
+}
+#endif // STRINGS_USE_MALLOC
+
+string_t* string_reserve(string_t *s, strlen_t size) {
+	ASSERT_STRING(s);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (s == NULL) {
+		return NULL;
+	}
+#endif
+
+#if STRINGS_USE_MALLOC
+	size = MIN(size, STRING_MAX_BYTES);
+	if (size >= s->allocated) {
+		set_allocated(s, snap_allocated((strlen_t )(size + 1U)));
+	}
+#else
+	UNUSED(size);
+#endif
+
+	return s;
+}
+string_t* string_shrink_to_fit(string_t *s) {
+	ASSERT_STRING(s);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (s == NULL) {
+		return NULL;
+	}
+#endif
+
+#if STRINGS_USE_SHARING
+	// Shrinking a shared buffer would mean copying it.
+	if (is_shared(s)) {
+		return s;
+	}
+#endif
+#if STRINGS_USE_MALLOC
+	if (s->allocated > (s->length + 1U)) {
+		set_allocated(s, (strlen_t )(s->length + 1U));
+	}
+#endif
+
+	return s;
+}
+
+
+/*
+* Arena functions
+*/
+#if STRINGS_USE_ARENAS
+string_arena_t* string_arena_init(string_arena_t *a, void *buf, size_t size) {
+	ulib_assert(a != NULL);
+	ulib_assert(POINTER_IS_VALID(buf) || (size == 0));
+
+#if DO_STRING_SAFETY_CHECKS
+	if (a == NULL) {
+		return NULL;
+	}
+	if (buf == NULL) {
+		size = 0;
+	}
+#endif
+
+	a->base = buf;
+	a->size = size;
+
+	return string_arena_reset(a);
+}
+string_arena_t* string_arena_reset(string_arena_t *a) {
+	ulib_assert(a != NULL);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (a == NULL) {
+		return NULL;
+	}
+#endif
+
+	a->used = 0;
+	a->last = NULL;
+
+	return a;
+}
+size_t string_arena_used(const string_arena_t *a) {
+	ulib_assert(a != NULL);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (a == NULL) {
+		return 0;
+	}
+#endif
+
+	return a->used;
+}
+string_t* string_init_in_arena(string_t *s, string_arena_t *a) {
+	ulib_assert(s != NULL);
+	ulib_assert(a != NULL);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (s == NULL) {
+		return NULL;
+	}
+#endif
+
+	s->arena = a;
+
+	return init_contents(s);
+}
+string_t* string_new_in_arena(string_arena_t *a) {
+	string_t *s;
+
+	ulib_assert(a != NULL);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (a == NULL) {
+		return NULL;
+	}
+#endif
+
+	if ((s = arena_alloc(a, sizeof(*s), ARENA_ALIGNMENT)) == NULL) {
+		return NULL;
+	}
+
+	return string_init_in_arena(s, a);
+}
+#endif // STRINGS_USE_ARENAS
+
+
 /*
 * Setting functions
 */
@@ -252,6 +730,9 @@ string_t* string_set_from_char(string_t *s, char c) {
 	ASSERT_STRING(s);
 	ASSERT_CHAR(c);
 
+	if (!begin_modify(s)) {
+		return s;
+	}
 	s->length = 1;
 	s->cstring[0] = c;
 	s->cstring[1] = 0;
@@ -270,42 +751,88 @@ string_t* string_printf(string_t *restrict s, const char *restrict format, ...)
 
 	return s;
 }
+#if STRINGS_USE_SHARING
+string_t* string_share(string_t *restrict dest, const string_t *restrict src) {
+	ASSERT_STRING(dest);
+	ASSERT_STRING(src);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (dest == NULL) {
+		return NULL;
+	}
+	if (src == NULL) {
+		return dest;
+	}
+#endif
+
+	if (dest->cstring == src->cstring) {
+		return dest;
+	}
+	// Arena-bound strings are freed with their arena, so they can't hold
+	// a reference that might outlive it.
+	if (!is_shareable(src) || (get_refs(share_header(src->cstring)) == UINT32_MAX)
+# if STRINGS_USE_ARENAS
+	    || (dest->arena != NULL)
+# endif
+	    ) {
+		return string_set_from_string(dest, src);
+	}
+
+	add_ref(share_header(src->cstring));
+	if (is_shareable(dest)) {
+		release_buffer(dest);
+	}
+	dest->cstring = src->cstring;
+	dest->allocated = src->allocated;
+	dest->length = src->length;
+#if STRINGS_CACHE_HASH
+	dest->hash = src->hash;
+#endif
+
+	return dest;
+}
+#endif // STRINGS_USE_SHARING
 
 /*
 * Appending functions
 */
 // Helper function to grow a string correctly.
-static void grow_allocated(string_t *s, strlen_t n) {
+// Returns how many of the n characters there's room for, which may be fewer
+// than requested if the allocation failed or the arena is full.
+static strlen_t grow_allocated(string_t *s, strlen_t n) {
 	//ASSERT_STRING(s);
 	//ulib_assert(n > 0);
 
 	UNUSED(s);
-	UNUSED(n);
 
 #if STRINGS_USE_MALLOC
-	if (COMBINED_LENGTH(s->length, n) >= s->allocated) {
-		strlen_t new_size, add = STRING_ALLOC_BLOCK_BYTES;
-		char *tmp;
-
-		//add = STRING_ALLOC_BLOCK_BYTES * (1 + (n / STRING_ALLOC_BLOCK_BYTES));
-		while (add < n) {
-			add += STRING_ALLOC_BLOCK_BYTES;
-		}
+	// COMBINED_LENGTH() is at most STRING_MAX_BYTES so this can't overflow.
+	strlen_t need = (strlen_t )(COMBINED_LENGTH(s->length, n) + 1U);
+
+	if (need > s->allocated) {
+		strlen_t new_size, add;
+
+# if STRING_GROW_METHOD == STRING_GROW_ADD
+		add = STRING_ALLOC_BLOCK_BYTES;
+# elif STRING_GROW_METHOD == STRING_GROW_MUL
+		add = (strlen_t )CLIP_UMUL(s->allocated, (strlen_t )(STRING_GROW_FACTOR-1U), STRING_MAX_ALLOCATED);
+# elif STRING_GROW_METHOD == STRING_GROW_FRAC
+		add = (strlen_t )(s->allocated / STRING_GROW_FACTOR);
+# else
+#  error "Unsupported STRING_GROW_METHOD"
+# endif
 
-		new_size = COMBINED_LENGTH(s->allocated, add);
-		//new_size = SNAP_TO_FACTOR(new_size, STRING_ALLOC_BLOCK_BYTES);
-		//new_size = MIN(new_size, STRING_MAX_BYTES);
-		if (new_size > s->allocated) {
-			tmp = realloc(s->cstring, new_size * sizeof(*s->cstring));
-			if (tmp != NULL) {
-				s->allocated = new_size;
-				s->cstring = tmp;
-			}
+		new_size = (strlen_t )CLIP_UADD(s->allocated, add, STRING_MAX_ALLOCATED);
+		new_size = snap_allocated(MAX(new_size, need));
+		// Settle for just what's needed if a bigger step can't be had.
+		if (!set_allocated(s, new_size) && (new_size > need)) {
+			set_allocated(s, need);
 		}
 	}
+	n = MIN(n, (strlen_t )(s->allocated - s->length - 1U));
 #endif
 
-	return;
+	return n;
 }
 string_t* string_append_from_char(string_t *s, char c) {
 	ASSERT_STRING(s);
@@ -320,9 +847,7 @@ string_t* string_append_from_char(string_t *s, char c) {
 	}
 #endif
 
-	if (s->length != STRING_MAX_BYTES) {
-		grow_allocated(s, 1);
-
+	if ((s->length != STRING_MAX_BYTES) && begin_modify(s) && (grow_allocated(s, 1) != 0)) {
 		s->cstring[s->length] = c;
 		++s->length;
 		s->cstring[s->length] = 0;
@@ -344,12 +869,12 @@ string_t* string_append_from_cstring(string_t *restrict s, const char *restrict
 	}
 #endif
 
-	if ((s->length != STRING_MAX_BYTES) && (c[0] != 0)) {
+	if ((s->length != STRING_MAX_BYTES) && (c[0] != 0) && begin_modify(s)) {
 		if (len == 0) {
 			len = strlen_checked(c);
 		}
 		len = (strlen_t )(COMBINED_LENGTH(s->length, len) - s->length);
-		grow_allocated(s, len);
+		len = grow_allocated(s, len);
 
 #if DO_STRING_SAFETY_CHECKS
 		strlen_t i, j;
@@ -386,15 +911,29 @@ string_t* string_appendf(string_t *restrict s, const char *restrict format, ...)
 	return s;
 }
 #if STRINGS_USE_INTERNAL_PRINTF
-static void string_putc(uint_fast8_t c) {
-	//ulib_assert(S_printf_string != NULL);
+// The printf sink context is the string itself, so formatting needs no
+// shared state. Spans are copied in whole; the terminating NUL is added
+// once formatting is finished.
+static void string_sink_write(void *ctx, const char *buf, size_t len) {
+	string_t *s = ctx;
+	strlen_t room;
 
-	string_append_from_char(S_printf_string, (char )c);
+	room = (strlen_t )(STRING_MAX_BYTES - s->length);
+	if (len > room) {
+		len = room;
+	}
+	if (len == 0) {
+		return;
+	}
+
+	len = grow_allocated(s, (strlen_t )len);
+	memcpy(&s->cstring[s->length], buf, len);
+	s->length += (strlen_t )len;
 
 	return;
 }
 string_t* string_appendf_va(string_t *restrict s, const char *restrict format, va_list arp) {
-	string_t *bs;
+	printf_sink_t sink;
 
 	ASSERT_STRING(s);
 	ASSERT_CSTRING(format);
@@ -409,10 +948,13 @@ string_t* string_appendf_va(string_t *restrict s, const char *restrict format, v
 	}
 #endif
 
-	bs = S_printf_string;
-	S_printf_string = s;
-	ulib_vprintf(string_putc, format, arp);
-	S_printf_string = bs;
+	if (!begin_modify(s)) {
+		return s;
+	}
+	sink.write = string_sink_write;
+	sink.ctx = s;
+	ulib_vprintf_sink(&sink, format, arp);
+	s->cstring[s->length] = 0;
 
 	return s;
 }
@@ -437,6 +979,9 @@ string_t* string_appendf_va(string_t *restrict s, const char *restrict format, v
 	}
 #endif
 
+	if (!begin_modify(s)) {
+		return s;
+	}
 #if STRINGS_USE_MALLOC
 	free_space = s->allocated - s->length;
 	if ((len = (strlen_t )vsnprintf(&s->cstring[s->length], free_space, format, arp)) > free_space) {
@@ -458,7 +1003,11 @@ string_t* string_appendf_va(string_t *restrict s, const char *restrict format, v
 #endif // STRINGS_USE_INTERNAL_PRINTF
 
 string_t* string_append_from_int(string_t *s, int n, uint8_t width, char pad) {
-	int m, r;
+	char buf[CSTRING_UINT64_DIGITS];
+	char *end = &buf[SIZEOF_ARRAY(buf)];
+	char *start;
+	uint_t u;
+	strlen_t len;
 
 	ulib_assert((pad != 0) || (width == 0));
 	ASSERT_STRING(s);
@@ -472,35 +1021,25 @@ string_t* string_append_from_int(string_t *s, int n, uint8_t width, char pad) {
 	}
 #endif
 
+	// Negating in unsigned arithmetic works for INT_MIN too.
+	u = (uint_t )n;
 	if (n < 0) {
 		string_append_from_char(s, '-');
-		n = -n;
+		u = 0U - u;
 	}
 
-	// FIXME: Handle n == INT_MAX
-	// Find the maximum number of needed characters
-	for (m = 1, r = 0; ((n / m) != 0); m *= 10, ++r) {
-		// Nothing to do in here
-	}
-	if (r == 0) {
-		if (width > 0) {
-			--width;
-			for (; r < width; ++r) {
-				string_append_from_char(s, pad);
-			}
-		}
-		return string_append_from_char(s, '0');
-	}
+#if UINT_MAX > UINT32_MAX
+	start = cstring_from_uint64_end(end, u);
+#else
+	start = cstring_from_uint32_end(end, u);
+#endif
+	len = (strlen_t )(end - start);
 
-	for (; width > r; ++r) {
+	for (; width > len; --width) {
 		string_append_from_char(s, pad);
 	}
-	// Without this first m /= 10 we'd have a leading 0.
-	for (m /= 10; m > 0; m /= 10) {
-		string_append_from_char(s, (char )('0' + ((n/m) % 10)));
-	}
 
-	return s;
+	return string_append_from_cstring(s, start, len);
 }
 string_t* string_append_from_int_div(string_t *s, int n, int d) {
 	ASSERT_STRING(s);
@@ -529,6 +1068,33 @@ string_t* string_append_from_int_div(string_t *s, int n, int d) {
 }
 
 
+string_t* string_append_replace_all(string_t *restrict s, strview_t src, strview_t from, strview_t to) {
+	strlen_t i;
+
+	ASSERT_STRING(s);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (s == NULL) {
+		return NULL;
+	}
+#endif
+
+	if (from.length == 0) {
+		return string_append_from_strview(s, src);
+	}
+	while ((i = strview_find(src, from)) != STRING_NOT_FOUND) {
+		if (s->length == STRING_MAX_BYTES) {
+			return s;
+		}
+		string_append_from_strview(s, strview_slice(src, 0, i));
+		string_append_from_strview(s, to);
+		src = strview_slice(src, (strlen_t )(i + from.length), src.length);
+	}
+
+	return string_append_from_strview(s, src);
+}
+
+
 /*
 * Content test functions
 */
@@ -551,22 +1117,90 @@ bool string_eq_string(const string_t *l, const string_t *r) {
 	}
 #endif
 
-	if (l->length == r->length) {
-		return (strcmp(l->cstring, r->cstring) == 0);
-	}
-	return false;
+	if (l == r) {
+		return true;
+	}
+	if (l->length != r->length) {
+		return false;
+	}
+#if STRINGS_USE_SHARING
+	if (l->cstring == r->cstring) {
+		return true;
+	}
+#endif
+#if STRINGS_CACHE_HASH
+	if ((l->hash != 0) && (r->hash != 0) && (l->hash != r->hash)) {
+		return false;
+	}
+#endif
+
+	// The lengths are known, so memcmp() can be used; it's usually much
+	// better optimized than strcmp().
+	return (memcmp(l->cstring, r->cstring, l->length) == 0);
+}
+bool string_is_shared(const string_t *s) {
+	ASSERT_STRING(s);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (s == NULL) {
+		return false;
+	}
+#endif
+
+#if STRINGS_USE_SHARING
+	return is_shared(s);
+#else
+	return false;
+#endif
+}
+bool string_eq_cstring(const string_t *l, const char *r) {
+	ASSERT_STRING(l);
+	ASSERT_CSTRING(r);
+
+#if DO_STRING_SAFETY_CHECKS
+	if ((l == NULL) || (r == NULL)) {
+		return false;
+	}
+#endif
+
+	// r's length isn't known so it can't be passed to memcmp(), but it can
+	// only match if it ends where l does.
+	return ((strncmp(l->cstring, r, l->length) == 0) && (r[l->length] == 0));
+}
+int string_cmp_string(const string_t *l, const string_t *r) {
+	ASSERT_STRING(l);
+	ASSERT_STRING(r);
+
+#if DO_STRING_SAFETY_CHECKS
+	if ((l == NULL) || (r == NULL)) {
+		return (l == r) ? 0 : ((l == NULL) ? -1 : 1);
+	}
+#endif
+
+	return strview_cmp(strview_from_string(l), strview_from_string(r));
 }
-bool string_eq_cstring(const string_t *l, const char *r) {
-	ASSERT_STRING(l);
-	ASSERT_CSTRING(r);
+uint32_t string_hash(string_t *s) {
+	uint32_t hash;
+
+	ASSERT_STRING(s);
 
 #if DO_STRING_SAFETY_CHECKS
-	if ((l == NULL) || (r == NULL)) {
-		return false;
+	if (s == NULL) {
+		return 0;
+	}
+#endif
+
+#if STRINGS_CACHE_HASH
+	if (s->hash != 0) {
+		return s->hash;
 	}
 #endif
+	hash = strview_hash(strview_from_string(s));
+#if STRINGS_CACHE_HASH
+	s->hash = hash;
+#endif
 
-	return (strcmp(l->cstring, r) == 0);
+	return hash;
 }
 
 
@@ -613,6 +1247,10 @@ string_t* string_dirname(string_t *s, char sep) {
 	}
 #endif
 
+	if (!begin_modify(s)) {
+		return s;
+	}
+
 	if (s->length == 0) {
 		return string_set_from_char(s, '.');
 	}
@@ -657,6 +1295,10 @@ string_t* string_basename(string_t *s, char sep) {
 	}
 #endif
 
+	if (!begin_modify(s)) {
+		return s;
+	}
+
 	if (s->length == 0) {
 		return string_set_from_char(s, '.');
 	}
@@ -705,6 +1347,10 @@ string_t* string_truncate(string_t *s, const strlen_t l) {
 	}
 #endif
 
+	if (!begin_modify(s)) {
+		return s;
+	}
+
 	if ((s->length > l) && (l <= STRING_MAX_BYTES)) {
 		s->length = l;
 		s->cstring[l] = 0;
@@ -742,6 +1388,10 @@ string_t* string_strip_trailing(string_t *s, char c) {
 	}
 #endif
 
+	if (!begin_modify(s)) {
+		return s;
+	}
+
 	if (s->length == 0) {
 		return s;
 	}
@@ -777,6 +1427,10 @@ string_t* string_strip_leading(string_t *s, char c) {
 	}
 #endif
 
+	if (!begin_modify(s)) {
+		return s;
+	}
+
 	if (s->length == 0) {
 		return s;
 	}
@@ -844,6 +1498,486 @@ string_t* string_pad_from_char(string_t *s, char c, strlen_t len) {
 }
 
 
+// Copy s with from replaced by to left to right. This only works in place
+// when to is no longer than from, or when the source starts far enough
+// past the destination to stay ahead of it.
+static strlen_t replace_forward(string_t *s, strlen_t r, strlen_t end, strview_t from, strview_t to) {
+	strlen_t w = 0;
+
+	while (r < end) {
+		strview_t src;
+		strlen_t i;
+
+		src.ptr = &s->cstring[r];
+		src.length = (strlen_t )(end - r);
+		if ((i = strview_find(src, from)) == STRING_NOT_FOUND) {
+			i = src.length;
+		}
+		memmove(&s->cstring[w], src.ptr, i);
+		w = (strlen_t )(w + i);
+		r = (strlen_t )(r + i);
+		if (r == end) {
+			break;
+		}
+		if (to.length > 0) {
+			memcpy(&s->cstring[w], to.ptr, to.length);
+		}
+		w = (strlen_t )(w + to.length);
+		r = (strlen_t )(r + from.length);
+	}
+
+	return w;
+}
+string_t* string_replace_all(string_t *s, strview_t from, strview_t to) {
+	strview_t src;
+	strlen_t i, need, limit, consumed, total, partial, shift;
+
+	ASSERT_STRING(s);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (s == NULL) {
+		return NULL;
+	}
+#endif
+
+	if (!begin_modify(s)) {
+		return s;
+	}
+
+	if ((from.length == 0) || (s->length < from.length)) {
+		return s;
+	}
+
+	if (to.length <= from.length) {
+		s->length = replace_forward(s, 0, s->length, from, to);
+		s->cstring[s->length] = 0;
+
+		return s;
+	}
+
+	// Find the length of the result and make room for it.
+	src = strview_from_string(s);
+	if ((i = strview_find(src, from)) == STRING_NOT_FOUND) {
+		return s;
+	}
+	need = s->length;
+	do {
+		need = COMBINED_LENGTH(need, (strlen_t )(to.length - from.length));
+		src = strview_slice(src, (strlen_t )(i + from.length), src.length);
+	} while ((need < STRING_MAX_BYTES) && ((i = strview_find(src, from)) != STRING_NOT_FOUND));
+	string_reserve(s, need);
+#if STRINGS_USE_MALLOC
+	limit = MIN(need, (strlen_t )(s->allocated - 1U));
+#else
+	limit = need;
+#endif
+
+	// Find how much of the source fits in the result. If the last replacement
+	// only partly fits, it's written separately at the end.
+	consumed = 0;
+	total = 0;
+	partial = 0;
+	while (true) {
+		strlen_t run;
+
+		src.ptr = &s->cstring[consumed];
+		src.length = (strlen_t )(s->length - consumed);
+		i = strview_find(src, from);
+		run = (i == STRING_NOT_FOUND) ? src.length : i;
+		if (run >= (limit - total)) {
+			consumed = (strlen_t )(consumed + (limit - total));
+			total = limit;
+			break;
+		}
+		consumed = (strlen_t )(consumed + run);
+		total = (strlen_t )(total + run);
+		if (i == STRING_NOT_FOUND) {
+			break;
+		}
+		if (to.length > (limit - total)) {
+			partial = (strlen_t )(limit - total);
+			break;
+		}
+		consumed = (strlen_t )(consumed + from.length);
+		total = (strlen_t )(total + to.length);
+	}
+
+	// Move the source to the end of the space the result will take up so
+	// that writing the result from the start never overtakes reading it.
+	shift = (strlen_t )(total - consumed);
+	memmove(&s->cstring[shift], s->cstring, consumed);
+	s->length = replace_forward(s, shift, total, from, to);
+	if (partial > 0) {
+		memcpy(&s->cstring[s->length], to.ptr, partial);
+		s->length = (strlen_t )(s->length + partial);
+	}
+	s->cstring[s->length] = 0;
+
+	return s;
+}
+
+
+/*
+* String view functions
+*/
+// Views of "." are returned for empty paths.
+static const char dot_path[] = ".";
+
+strview_t strview_from_string(const string_t *s) {
+	strview_t v = { NULL, 0 };
+
+	ASSERT_STRING(s);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (s == NULL) {
+		return v;
+	}
+#endif
+
+	v.ptr = s->cstring;
+	v.length = s->length;
+
+	return v;
+}
+strview_t strview_from_cstring(const char *c, strlen_t len) {
+	strview_t v = { NULL, 0 };
+
+	ASSERT_CSTRING(c);
+	ASSERT_LENGTH(len);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (c == NULL) {
+		return v;
+	}
+#endif
+
+	v.ptr = c;
+	v.length = (len == 0) ? strlen_checked(c) : len;
+
+	return v;
+}
+strview_t strview_slice(strview_t v, strlen_t start, strlen_t len) {
+	ASSERT_LENGTH(start);
+	ASSERT_LENGTH(len);
+
+	if (start >= v.length) {
+		v.ptr = (v.ptr != NULL) ? &v.ptr[v.length] : NULL;
+		v.length = 0;
+	} else {
+		v.ptr = &v.ptr[start];
+		v.length = MIN(len, (strlen_t )(v.length - start));
+	}
+
+	return v;
+}
+strview_t strview_strip_leading(strview_t v, char c) {
+	ASSERT_CHAR(c);
+
+	while ((v.length > 0) && (v.ptr[0] == c)) {
+		++v.ptr;
+		--v.length;
+	}
+
+	return v;
+}
+strview_t strview_strip_trailing(strview_t v, char c) {
+	ASSERT_CHAR(c);
+
+	while ((v.length > 0) && (v.ptr[v.length-1] == c)) {
+		--v.length;
+	}
+
+	return v;
+}
+strview_t strview_trim_char(strview_t v, char c) {
+	return strview_strip_leading(strview_strip_trailing(v, c), c);
+}
+strview_t strview_pop_token(strview_t *v, char sep) {
+	strview_t token;
+	const char *end;
+
+	ulib_assert(v != NULL);
+	ASSERT_CHAR(sep);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (v == NULL) {
+		token.ptr = NULL;
+		token.length = 0;
+		return token;
+	}
+#endif
+
+	token.ptr = v->ptr;
+	if ((v->length == 0) || ((end = memchr(v->ptr, sep, v->length)) == NULL)) {
+		token.length = v->length;
+		v->ptr = (v->ptr != NULL) ? &v->ptr[v->length] : NULL;
+		v->length = 0;
+	} else {
+		token.length = (strlen_t )(end - v->ptr);
+		v->ptr = end + 1;
+		v->length = (strlen_t )(v->length - (token.length + 1U));
+	}
+
+	return token;
+}
+strview_t strview_pop_delim(strview_t *v, strview_t delim) {
+	strview_t token;
+	const char *end;
+
+	ulib_assert(v != NULL);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (v == NULL) {
+		token.ptr = NULL;
+		token.length = 0;
+		return token;
+	}
+#endif
+
+	token.ptr = v->ptr;
+	if ((v->length == 0) || (delim.length == 0) || ((end = cstring_find(v->ptr, v->length, delim.ptr, delim.length)) == NULL)) {
+		token.length = v->length;
+		v->ptr = (v->ptr != NULL) ? &v->ptr[v->length] : NULL;
+		v->length = 0;
+	} else {
+		token.length = (strlen_t )(end - v->ptr);
+		v->ptr = end + delim.length;
+		v->length = (strlen_t )(v->length - (token.length + delim.length));
+	}
+
+	return token;
+}
+strlen_t strview_split(strview_t v, strview_t delim, strview_t *ret_parts, strlen_t max_parts) {
+	strlen_t n = 0;
+
+	ulib_assert((ret_parts == NULL) || (max_parts > 0));
+
+#if DO_STRING_SAFETY_CHECKS
+	if ((ret_parts != NULL) && (max_parts == 0)) {
+		return 0;
+	}
+#endif
+
+	while (v.length > 0) {
+		if (ret_parts != NULL) {
+			if ((n + 1U) == max_parts) {
+				ret_parts[n] = v;
+				return max_parts;
+			}
+			ret_parts[n] = strview_pop_delim(&v, delim);
+		} else {
+			strview_pop_delim(&v, delim);
+		}
+		++n;
+	}
+
+	return n;
+}
+strlen_t strview_find_char(strview_t v, char c) {
+	const char *p;
+
+	if ((v.length == 0) || ((p = memchr(v.ptr, c, v.length)) == NULL)) {
+		return STRING_NOT_FOUND;
+	}
+
+	return (strlen_t )(p - v.ptr);
+}
+strlen_t strview_find(strview_t v, strview_t needle) {
+	const char *p;
+
+	if (needle.length == 0) {
+		return 0;
+	}
+	if ((p = cstring_find(v.ptr, v.length, needle.ptr, needle.length)) == NULL) {
+		return STRING_NOT_FOUND;
+	}
+
+	return (strlen_t )(p - v.ptr);
+}
+strview_t strview_dirname(strview_t v, char sep) {
+	strlen_t i;
+
+	ASSERT_CHAR(sep);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (sep == 0) {
+		sep = '/';
+	}
+#endif
+
+	if (v.length == 0) {
+		return strview_from_cstring(dot_path, 1);
+	}
+
+	// Skip trailing separators, then the basename, then the separators
+	// before it.
+	for (i = v.length; (i > 1) && (v.ptr[i-1] == sep); --i) {
+		// Nothing to do here
+	}
+	for (; (i > 0) && (v.ptr[i-1] != sep); --i) {
+		// Nothing to do here
+	}
+	if (i == 0) {
+		return strview_from_cstring(dot_path, 1);
+	}
+	for (; (i > 1) && (v.ptr[i-1] == sep); --i) {
+		// Nothing to do here
+	}
+	v.length = i;
+
+	return v;
+}
+strview_t strview_basename(strview_t v, char sep) {
+	strlen_t start, end;
+
+	ASSERT_CHAR(sep);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (sep == 0) {
+		return v;
+	}
+#endif
+
+	if (v.length == 0) {
+		return strview_from_cstring(dot_path, 1);
+	}
+
+	for (end = v.length; (end > 1) && (v.ptr[end-1] == sep); --end) {
+		// Nothing to do here
+	}
+	// This means the string was just '/' or '////' or something:
+	if ((end == 1) && (v.ptr[0] == sep)) {
+		v.length = 1;
+		return v;
+	}
+	for (start = end; (start > 0) && (v.ptr[start-1] != sep); --start) {
+		// Nothing to do here
+	}
+	v.ptr = &v.ptr[start];
+	v.length = (strlen_t )(end - start);
+
+	return v;
+}
+bool strview_eq(strview_t l, strview_t r) {
+	if (l.length != r.length) {
+		return false;
+	}
+
+	return ((l.length == 0) || (memcmp(l.ptr, r.ptr, l.length) == 0));
+}
+bool strview_eq_cstring(strview_t l, const char *r) {
+	ASSERT_CSTRING(r);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (r == NULL) {
+		return false;
+	}
+#endif
+
+	// The cstring must end exactly where the view does.
+	if ((l.length > 0) && (strncmp(l.ptr, r, l.length) != 0)) {
+		return false;
+	}
+	return (r[l.length] == 0);
+}
+int strview_cmp(strview_t l, strview_t r) {
+	strlen_t len = MIN(l.length, r.length);
+	int cmp = (len == 0) ? 0 : memcmp(l.ptr, r.ptr, len);
+
+	if (cmp != 0) {
+		return cmp;
+	}
+	if (l.length == r.length) {
+		return 0;
+	}
+	return (l.length < r.length) ? -1 : 1;
+}
+uint32_t strview_hash(strview_t v) {
+	// 32-bit FNV-1a
+	uint32_t hash = 0x811C9DC5U;
+
+	for (strlen_t i = 0; i < v.length; ++i) {
+		hash ^= (uint8_t )v.ptr[i];
+		hash *= 0x01000193U;
+	}
+
+	return hash;
+}
+// Check whether a view points into a string's own buffer, and if so store
+// its offset in ret_offset and its length, clipped to the string's contents,
+// in ret_length.
+// Views are compared as addresses because they may come from anywhere.
+static bool view_is_in_string(const string_t *s, strview_t v, strlen_t *ret_offset, strlen_t *ret_length) {
+	uintptr_t start = (uintptr_t )s->cstring;
+	uintptr_t p = (uintptr_t )v.ptr;
+	strlen_t offset;
+
+	if ((v.ptr == NULL) || (s->cstring == NULL) || (p < start) || (p >= (start + s->allocated))) {
+		return false;
+	}
+
+	offset = (strlen_t )(p - start);
+	*ret_offset = offset;
+	*ret_length = (offset < s->length) ? MIN(v.length, (strlen_t )(s->length - offset)) : 0;
+
+	return true;
+}
+string_t* string_set_from_strview(string_t *s, strview_t v) {
+	strlen_t offset, len;
+
+	ASSERT_STRING(s);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (s == NULL) {
+		return NULL;
+	}
+#endif
+
+	// Clearing the string first would overwrite the start of the view.
+	if (view_is_in_string(s, v, &offset, &len)) {
+		if (begin_modify(s)) {
+			memmove(s->cstring, &s->cstring[offset], len);
+			s->length = len;
+			s->cstring[len] = 0;
+		}
+		return s;
+	}
+
+	return string_append_from_strview(string_clear(s), v);
+}
+string_t* string_append_from_strview(string_t *s, strview_t v) {
+	strlen_t offset, len;
+
+	ASSERT_STRING(s);
+
+#if DO_STRING_SAFETY_CHECKS
+	if (s == NULL) {
+		return NULL;
+	}
+#endif
+
+	// Growing the string may move its buffer, so only the view's offset can
+	// be relied on afterwards.
+	if (view_is_in_string(s, v, &offset, &len)) {
+		if ((len > 0) && (s->length != STRING_MAX_BYTES) && begin_modify(s)) {
+			len = (strlen_t )(COMBINED_LENGTH(s->length, len) - s->length);
+			len = grow_allocated(s, len);
+			memcpy(&s->cstring[s->length], &s->cstring[offset], len);
+			s->length += len;
+			s->cstring[s->length] = 0;
+		}
+		return s;
+	}
+
+	// string_append_from_cstring() treats a length of 0 as a request to use
+	// strlen().
+	if (v.length == 0) {
+		return s;
+	}
+	return string_append_from_cstring(s, v.ptr, v.length);
+}
+
+
 #else
 	// ISO C forbids empty translation units, this makes it happy.
 	typedef int make_iso_compilers_happy;
@@ -26,6 +26,23 @@
 #ifndef ULIB_DO_SAFETY_CHECKS
 # define ULIB_DO_SAFETY_CHECKS 1
 #endif
+//
+// If non-zero, the default size limits of arrays, buffers, lists, byte FIFOs,
+// and strings are raised from 64KiB to one less than the largest size_t so
+// that their length types are as wide as size_t. This is meant for hosted
+// systems, where the smaller limits are easy to hit and anything past them
+// is dropped. Limits set explicitly below still take precedence.
+// Modules which don't use malloc() allocate their limits statically, so this
+// requires ULIB_USE_MALLOC.
+#ifndef ULIB_LARGE_LIMITS
+# define ULIB_LARGE_LIMITS 0
+#endif
+#if ULIB_LARGE_LIMITS
+# include <stdint.h>
+# define ULIB_DEFAULT_MAX_SIZE (SIZE_MAX - 1U)
+#else
+# define ULIB_DEFAULT_MAX_SIZE (0xFFFFU - 1U)
+#endif
 
 
 /*
@@ -66,7 +83,7 @@
 // one less than the max of an unsigned int type will result in less used
 // space than using the max value itself.
 #ifndef ARRAY_MAX_OBJECTS
-# define ARRAY_MAX_OBJECTS (0xFFFFU - 1U)
+# define ARRAY_MAX_OBJECTS ULIB_DEFAULT_MAX_SIZE
 #endif
 //
 // Allocated size of an array when first created.
@@ -125,6 +142,14 @@
 # define ASCII_SUBSTITUTE_FOR_CTYPE 0
 #endif
 //
+// If non-zero, classify characters by looking them up in a 256-byte table
+// and inline the ascii_is_*() functions. This also provides
+// ascii_classify_block() and ascii_span() for scanning several bytes at once.
+// Ignored when ASCII_SUBSTITUTE_WITH_CTYPE is set.
+#ifndef ASCII_USE_CLASS_TABLE
+# define ASCII_USE_CLASS_TABLE 1
+#endif
+//
 // If non-zero, perform additional checks to handle common problems like being
 // passed NULL inputs.
 #ifndef DO_ASCII_SAFETY_CHECKS
@@ -174,7 +199,7 @@
 // one less than the max of an unsigned int type will result in less used
 // space than using the max value itself.
 #ifndef BUFFER_MAX_BYTES
-# define BUFFER_MAX_BYTES (0xFFFFU - 1U)
+# define BUFFER_MAX_BYTES ULIB_DEFAULT_MAX_SIZE
 #endif
 //
 // Size of a buffer when first created.
@@ -219,6 +244,13 @@
 #ifndef DO_CSTRING_SAFETY_CHECKS
 # define DO_CSTRING_SAFETY_CHECKS ULIB_DO_SAFETY_CHECKS
 #endif
+//
+// If non-zero, use the C library's memmem() for substring searches instead
+// of the internal implementation. memmem() isn't part of C99 but where it's
+// available it's usually faster for long needles.
+#ifndef CSTRINGS_USE_MEMMEM
+# define CSTRINGS_USE_MEMMEM 0
+#endif
 
 
 /*
@@ -407,6 +439,40 @@
 #endif
 
 
+/*
+* String interning module configuration
+*/
+// Enable this module
+// This module requires ULIB_USE_MALLOC.
+#ifndef ULIB_ENABLE_INTERN
+# define ULIB_ENABLE_INTERN (ULIB_ENABLE_DEFAULT && ULIB_USE_MALLOC)
+#endif
+//
+// Interned strings are packed into blocks of this many bytes. Strings too
+// big to fit get a block of their own.
+#ifndef INTERN_BLOCK_BYTES
+# define INTERN_BLOCK_BYTES 1024U
+#endif
+//
+// The number of hash table slots allocated when the first string is
+// interned. Must be a power of 2.
+#ifndef INTERN_MIN_SLOTS
+# define INTERN_MIN_SLOTS 16U
+#endif
+//
+// If non-zero, guard each table with a spinlock so that it can be used
+// from multiple threads. This uses the GCC __atomic builtins.
+#ifndef INTERN_USE_LOCKING
+# define INTERN_USE_LOCKING 1
+#endif
+//
+// If non-zero, perform additional checks to handle common problems like being
+// passed NULL inputs.
+#ifndef DO_INTERN_SAFETY_CHECKS
+# define DO_INTERN_SAFETY_CHECKS ULIB_DO_SAFETY_CHECKS
+#endif
+
+
 /*
 * Linked-list module configuration
 */
@@ -419,7 +485,7 @@
 // one less than the max of an unsigned int type will result in less used
 // space than using the max value itself.
 #ifndef LIST_MAX_OBJECTS
-# define LIST_MAX_OBJECTS (0xFFFFU - 1U)
+# define LIST_MAX_OBJECTS ULIB_DEFAULT_MAX_SIZE
 #endif
 //
 // If non-zero, new entries are created with malloc. Otherwise a pointer to
@@ -483,6 +549,19 @@
 # define MSG_FORBIDDEN_CONFIG_FLAGS 0
 #endif
 //
+// Calls to MSG_PRINT() and MSG_PRINT_MODULE() with a constant priority greater
+// than this are removed at compile time. The default of 3 (MSG_VERB_TMI)
+// keeps everything.
+#ifndef MSG_VERBOSITY_MAX
+# define MSG_VERBOSITY_MAX 3
+#endif
+//
+// The number of modules which can be given their own verbosity level for
+// use with MSG_PRINT_MODULE(). If 0, per-module verbosity is disabled.
+#ifndef MSG_MODULE_COUNT
+# define MSG_MODULE_COUNT 8U
+#endif
+//
 // Maximum size of short printed strings like line prefixes and log file
 // names, including the trailing NUL byte.
 #ifndef MSG_STR_BYTES
@@ -500,6 +579,71 @@
 # define MSG_USE_INTERNAL_PRINTF ULIB_ENABLE_PRINTF
 #endif
 //
+// Source of the time used by msg_print_log_time_cached(). If non-zero, use
+// CLOCK_REALTIME_COARSE where available; it's much cheaper to read but only
+// accurate to the scheduler tick.
+#ifndef MSG_LOG_TIME_USE_COARSE_CLOCK
+# define MSG_LOG_TIME_USE_COARSE_CLOCK 0
+#endif
+//
+// Number of sub-second digits printed by msg_print_log_time_cached(), from
+// 0 to 9.
+#ifndef MSG_LOG_TIME_SUBSEC_DIGITS
+# define MSG_LOG_TIME_SUBSEC_DIGITS 0
+#endif
+//
+// If non-zero, msg_print_log_time_cached() prints UTC rather than local time.
+#ifndef MSG_LOG_TIME_USE_UTC
+# define MSG_LOG_TIME_USE_UTC 0
+#endif
+//
+// A macro or function used to get a millisecond timestamp for rate-limiting.
+// The default uses clock_gettime() and is only available when MSG_USE_UNIX_IO
+// is set.
+//#define MSG_RATE_LIMIT_GET_MS() (GET_SYSTICKS_MS())
+//
+// The number of call sites which can be tracked at once for rate-limiting
+// with MSG_FLAG_RATE_LIMIT. Must be a power of 2; if 0, rate-limiting support
+// is disabled. Defaults to 0 when there's no clock to use.
+#ifndef MSG_RATE_LIMIT_SLOTS
+# if MSG_USE_UNIX_IO || defined(MSG_RATE_LIMIT_GET_MS)
+#  define MSG_RATE_LIMIT_SLOTS 16U
+# else
+#  define MSG_RATE_LIMIT_SLOTS 0
+# endif
+#endif
+//
+// Size of the buffer used to read from stdin in msg_gets(), msg_getline(),
+// and msg_ask(). Lines longer than this are returned by msg_getline() in
+// pieces.
+#ifndef MSG_STDIN_BUFFER_BYTES
+# define MSG_STDIN_BUFFER_BYTES 256U
+#endif
+//
+// When MSG_USE_MALLOC isn't set, this is the maximum size of the path passed
+// to msg_open_log() that will be remembered for log rotation, including the
+// trailing NUL byte.
+#ifndef MSG_LOG_PATH_BYTES
+# define MSG_LOG_PATH_BYTES 128U
+#endif
+//
+// If non-zero, enable msg_open_ring_log(). Requires MSG_USE_UNIX_IO.
+#ifndef MSG_USE_RING_LOG
+# define MSG_USE_RING_LOG MSG_USE_UNIX_IO
+#endif
+//
+// Size of each record in the ring log, including an 8-byte header. Longer
+// messages are split across multiple records.
+#ifndef MSG_RING_LOG_RECORD_BYTES
+# define MSG_RING_LOG_RECORD_BYTES 128U
+#endif
+//
+// Maximum length of messages copied to the ring log when MSG_USE_INTERNAL_PRINTF
+// isn't set; anything longer is truncated.
+#ifndef MSG_RING_LOG_LINE_BYTES
+# define MSG_RING_LOG_LINE_BYTES 512U
+#endif
+//
 // If non-zero, the msg subsystem will use malloc() to allocate memory. Otherwise
 // all memory is statically-allocated.
 #ifndef MSG_USE_MALLOC
@@ -639,6 +783,28 @@
 #ifndef PRINTF_ALLOW_POSITIVE_SIGNS
 # define PRINTF_ALLOW_POSITIVE_SIGNS (!PRINTF_USE_MINIMAL_FEATURE_SET)
 #endif
+//
+// Allow printing doubles with the 'f', 'e', and 'g' conversions
+// The conversion is exact, which needs a few KB of code and around 700 bytes
+// of stack
+#ifndef PRINTF_ALLOW_FLOATS
+# define PRINTF_ALLOW_FLOATS 0
+#endif
+//
+// The maximum number of significant digits calculated when printing doubles;
+// any digits requested beyond this are printed as 0s
+// This is the size of a stack buffer and must be at least 17, the most needed
+// to uniquely identify a double
+#ifndef PRINTF_FLOAT_MAX_DIGITS
+# define PRINTF_FLOAT_MAX_DIGITS 40U
+#endif
+//
+// If set, 'g' and 'G' without a precision print the shortest string that
+// reads back as the same double instead of 6 significant digits
+// This isn't standard, so output differs from the C library's printf()
+#ifndef PRINTF_FLOAT_SHORTEST_G
+# define PRINTF_FLOAT_SHORTEST_G 0
+#endif
 
 
 /*
@@ -653,7 +819,7 @@
 // one less than the max of an unsigned int type will result in less used
 // space than using the max value itself.
 #ifndef FIFO_UINT8_MAX_SIZE
-# define FIFO_UINT8_MAX_SIZE (0xFFFFU - 1U)
+# define FIFO_UINT8_MAX_SIZE ULIB_DEFAULT_MAX_SIZE
 #endif
 //
 // If non-zero, perform additional checks to handle common problems like being
@@ -663,6 +829,40 @@
 #endif
 
 
+/*
+* Rope module configuration
+*/
+// Enable this module
+// This module requires ULIB_USE_MALLOC.
+#ifndef ULIB_ENABLE_ROPE
+# define ULIB_ENABLE_ROPE (ULIB_ENABLE_DEFAULT && ULIB_USE_MALLOC)
+#endif
+//
+// Copied text is stored in blocks of this many bytes, including a small
+// header. Text too big to fit in one gets a block sized to hold it.
+#ifndef ROPE_BLOCK_BYTES
+# define ROPE_BLOCK_BYTES 4096U
+#endif
+//
+// If non-zero, provide rope_get_iovec() and rope_write_fd(). This requires
+// <sys/uio.h> and writev().
+#ifndef ROPE_USE_IOVEC
+# define ROPE_USE_IOVEC 1
+#endif
+//
+// The number of struct iovecs rope_write_fd() keeps on the stack and passes
+// to each call to writev().
+#ifndef ROPE_IOVEC_BATCH
+# define ROPE_IOVEC_BATCH 16U
+#endif
+//
+// If non-zero, perform additional checks to handle common problems like being
+// passed NULL inputs.
+#ifndef DO_ROPE_SAFETY_CHECKS
+# define DO_ROPE_SAFETY_CHECKS ULIB_DO_SAFETY_CHECKS
+#endif
+
+
 /*
 * String module configuration
 */
@@ -675,7 +875,7 @@
 // if the total length including NUL needs to fit in a uint8_t. The type
 // of strlen_t is determined by strings.h based on this value.
 #ifndef STRING_MAX_BYTES
-# define STRING_MAX_BYTES (0xFFFFU - 1U)
+# define STRING_MAX_BYTES ULIB_DEFAULT_MAX_SIZE
 #endif
 //
 // If non-zero, use malloc() to re-size strings as needed. They still won't
@@ -684,13 +884,62 @@
 # define STRINGS_USE_MALLOC ULIB_USE_MALLOC
 #endif
 //
-// When STRINGS_USE_MALLOC is set, grow the string in blocks of this size.
+// When STRINGS_USE_MALLOC is set, strings of less than this many bytes
+// (including the trailing NUL) are stored in the string_t itself instead of
+// being allocated separately. Set to 0 to always allocate.
+#ifndef STRING_SMALL_BYTES
+# define STRING_SMALL_BYTES 24U
+#endif
+//
+// When STRINGS_USE_MALLOC is set, allocate strings in blocks of this size.
 #ifndef STRING_ALLOC_BLOCK_BYTES
 # define STRING_ALLOC_BLOCK_BYTES 16U
 #endif
 //
+// Factor by which to grow a string when it would otherwise overflow.
+#ifndef STRING_GROW_FACTOR
+# define STRING_GROW_FACTOR 2U
+#endif
+//
+// Method of string growth. See the description for ARRAY_GROW_METHOD for
+// details, except that STRING_GROW_ADD adds STRING_ALLOC_BLOCK_BYTES instead
+// of STRING_GROW_FACTOR and there's no STRING_GROW_NONE. Strings always grow
+// at least enough to hold what's being added.
+#ifndef STRING_GROW_METHOD
+# define STRING_GROW_METHOD STRING_GROW_MUL
+#endif
+//
+// If non-zero, strings may be bound to a string_arena_t so that their
+// contents are carved out of a single caller-supplied buffer which is
+// released all at once instead of being malloc()ed and free()d one by one.
+// Requires STRINGS_USE_MALLOC.
+#ifndef STRINGS_USE_ARENAS
+# define STRINGS_USE_ARENAS 0
+#endif
+//
+// If non-zero, a string_t remembers the hash of its contents once
+// string_hash() has calculated it, so string_eq_string() can reject most
+// unequal strings of the same length without comparing them.
+#ifndef STRINGS_CACHE_HASH
+# define STRINGS_CACHE_HASH 1
+#endif
+//
+// If non-zero, strings copied by string_new_from_string() or string_share()
+// share one allocated buffer until one of them is changed. This adds a
+// reference count to each allocation. Requires STRINGS_USE_MALLOC.
+#ifndef STRINGS_USE_SHARING
+# define STRINGS_USE_SHARING 0
+#endif
+//
+// If non-zero, the reference counts of shared buffers are updated atomically
+// so that strings sharing a buffer can be used from different threads. This
+// uses the GCC __atomic builtins.
+#ifndef STRINGS_SHARE_ATOMIC
+# define STRINGS_SHARE_ATOMIC 1
+#endif
+//
 // If non-zero, use the internal printf() implementation for printing to strings.
-// This implementation isn't thread-safe and lacks some features but may be smaller.
+// This implementation lacks some features but may be smaller.
 #ifndef STRINGS_USE_INTERNAL_PRINTF
 # define STRINGS_USE_INTERNAL_PRINTF ULIB_ENABLE_PRINTF
 #endif